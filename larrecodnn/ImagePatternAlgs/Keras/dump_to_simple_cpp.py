@@ -9,6 +9,8 @@ parser = argparse.ArgumentParser(description='This is a simple script to dump Ke
 parser.add_argument('-a', '--architecture', help="JSON with model architecture", required=True)
 parser.add_argument('-w', '--weights', help="Model weights in HDF5 format", required=True)
 parser.add_argument('-o', '--output', help="Ouput file name", required=True)
+parser.add_argument('--prune-dense', help="Fraction of the smallest weights of each Dense layer to set to zero (magnitude pruning)", type=float, default=0)
+parser.add_argument('--sparse-dense', help="Write Dense layers with at most this fraction of non-zero weights as SparseDense", type=float, default=0)
 
 args = parser.parse_args()
 
@@ -23,13 +25,27 @@ model.load_weights(args.weights)
 model.compile(loss='categorical_crossentropy', optimizer='adadelta')
 arch = json.loads(arch)
 
+def strides(l): # written only if not default, so files can be read also by older code
+    sx, sy = l['config'].get('subsample', (1, 1))
+    return '' if (sx, sy) == (1, 1) else ' ' + str(sx) + ' ' + str(sy)
+
 with open(args.output, 'w') as fout:
     fout.write('layers ' + str(len(model.layers)) + '\n')
 
     layers = []
     for ind, l in enumerate(arch["config"]):
         print ind, l
-        fout.write('layer ' + str(ind) + ' ' + l['class_name'] + '\n')
+        class_name = l['class_name']
+        if class_name == 'Dense':
+            W = model.layers[ind].get_weights()[0]
+            if args.prune_dense > 0:
+                thr = np.percentile(np.abs(W), 100 * args.prune_dense)
+                W = np.where(np.abs(W) <= thr, 0, W)
+            density = np.count_nonzero(W) / float(W.size)
+            print 'non-zero weights fraction', density
+            if density <= args.sparse_dense:
+                class_name = 'SparseDense'
+        fout.write('layer ' + str(ind) + ' ' + class_name + '\n')
 
         print str(ind), l['class_name']
         layers += [l['class_name']]
@@ -42,7 +58,7 @@ with open(args.output, 'w') as fout:
 
             W = model.layers[ind].get_weights()[0]
             print W.shape
-            fout.write(str(W.shape[0]) + ' ' + str(W.shape[1]) + ' ' + str(W.shape[2]) + ' ' + str(W.shape[3]) + ' ' + l['config']['border_mode'] + '\n')
+            fout.write(str(W.shape[0]) + ' ' + str(W.shape[1]) + ' ' + str(W.shape[2]) + ' ' + str(W.shape[3]) + ' ' + l['config']['border_mode'] + strides(l) + '\n')
 
             for i in range(W.shape[0]):
                 for j in range(W.shape[1]):
@@ -50,15 +66,48 @@ with open(args.output, 'w') as fout:
                         fout.write(str(W[i,j,k]) + '\n')
             fout.write(str(model.layers[ind].get_weights()[1]) + '\n')
 
+        if l['class_name'] == 'SeparableConvolution2D':
+            # depthwise kernels (rows, cols, depth, multiplier), pointwise (1, 1, depth * multiplier, kernels)
+            DW, PW, B = model.layers[ind].get_weights()
+            if l['config'].get('dim_ordering', 'tf') == 'th':
+                DW, PW = DW.transpose(2, 3, 1, 0), PW.transpose(2, 3, 1, 0)
+            print DW.shape, PW.shape
+            fout.write(str(PW.shape[3]) + ' ' + str(DW.shape[2]) + ' ' + str(DW.shape[0]) + ' ' + str(DW.shape[1]) + ' ' + str(DW.shape[3]) + ' ' + l['config']['border_mode'] + strides(l) + '\n')
+            for d in range(DW.shape[2]):
+                for m in range(DW.shape[3]):
+                    for r in range(DW.shape[0]):
+                        fout.write('[' + ' '.join(repr(float(v)) for v in DW[r, :, d, m]) + ']\n')
+            for k in range(PW.shape[3]):
+                fout.write('[' + ' '.join(repr(float(v)) for v in PW[0, 0, :, k]) + ']\n')
+            fout.write('[' + ' '.join(repr(float(v)) for v in B) + ']\n')
+
+        if l['class_name'] == 'BatchNormalization':
+            # folded into the preceding Convolution2D / Dense layer when the model is loaded
+            if l['config'].get('mode', 0) != 0:
+                raise ValueError('BatchNormalization only in mode 0 is supported.')
+            gamma, beta, mean, var = model.layers[ind].get_weights()
+            fout.write(str(gamma.shape[0]) + ' ' + repr(float(l['config']['epsilon'])) + '\n')
+            for a in (gamma, beta, mean, var):
+                fout.write('[' + ' '.join(repr(float(v)) for v in a) + ']\n')
+
         if l['class_name'] == 'Activation':
             fout.write(l['config']['activation'] + '\n')
         if l['class_name'] == 'MaxPooling2D':
             fout.write(str(l['config']['pool_size'][0]) + ' ' + str(l['config']['pool_size'][1]) + '\n')
         #if l['class_name'] == 'Flatten':
         #    print l['config']['name']
-        if l['class_name'] == 'Dense':
+        if class_name == 'SparseDense':
+            # CSR, rows are inputs: row pointers, neuron indices, values of non-zero weights
+            nz = [np.nonzero(w)[0] for w in W]
+            row_ptr = np.cumsum([0] + [len(n) for n in nz])
+            print W.shape, 'sparse', row_ptr[-1]
+            fout.write(str(W.shape[0]) + ' ' + str(W.shape[1]) + ' ' + str(row_ptr[-1]) + '\n')
+            fout.write('[' + ' '.join(str(v) for v in row_ptr) + ']\n')
+            fout.write('[' + ' '.join(str(c) for n in nz for c in n) + ']\n')
+            fout.write('[' + ' '.join(repr(float(W[i, c])) for i, n in enumerate(nz) for c in n) + ']\n')
+            fout.write('[' + ' '.join(repr(float(v)) for v in model.layers[ind].get_weights()[1]) + ']\n')
+        if class_name == 'Dense':
             #fout.write(str(l['config']['output_dim']) + '\n')
-            W = model.layers[ind].get_weights()[0]
             print W.shape
             fout.write(str(W.shape[0]) + ' ' + str(W.shape[1]) + '\n')
 
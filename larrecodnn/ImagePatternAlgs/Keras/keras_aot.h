@@ -0,0 +1,165 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// keras_aot.h: Keras model layers with all shapes known at compile time
+//
+// Used by the C++ sources generated from .nnet files with nnet_to_cpp.py, see README.md.
+// Each generated source is compiled into a plugin library exporting the C interface below,
+// which is loaded with dlopen (e.g. by the PointIdAlgAot tool). Layers are computed as in
+// KerasModel (direct convolution, same summation order), results differ only by rounding
+// if the plugin is compiled with FMA instructions.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef KERAS_AOT__H
+#define KERAS_AOT__H
+
+#include <cmath>
+
+extern "C" {
+  struct keras_aot_info {
+    const char * name;              // name of the source .nnet file
+    int in_depth, in_rows, in_cols; // input image shape
+    int out_size;                   // length of the output vector
+  };
+
+  // symbols exported by the plugin:
+  //   const keras_aot_info * keras_aot_model_info(void);
+  //   void keras_aot_compute(const float * in, float * out); // in: depth, rows, cols
+  // keras_aot_compute is reentrant, buffers are thread local
+  typedef const keras_aot_info * (*keras_aot_info_fn)(void);
+  typedef void (*keras_aot_compute_fn)(const float *, float *);
+}
+
+namespace keras
+{
+  namespace aot
+  {
+    // y[K][OR][OC], x[D][R][C], w[K][D][KR][KC] with rows and cols flipped, b[K]
+    template <int K, int D, int R, int C, int KR, int KC, bool SAME>
+    struct Conv2D {
+      static constexpr int SX = (KR - 1) / 2, SY = (KC - 1) / 2;
+      static constexpr int OR = SAME ? R : R - 2 * SX, OC = SAME ? C : C - 2 * SY;
+      static constexpr int OFF_X = SAME ? 0 : SX, OFF_Y = SAME ? 0 : SY;
+      static constexpr int I_END = R - (KR - 1 - SX), J_END = C - (KC - 1 - SY);
+      static constexpr int size = K * OR * OC;
+
+      static void compute(const float * __restrict x, float * __restrict y,
+                          const float * __restrict w, const float * __restrict b)
+      {
+        for(int i = 0; i < size; ++i) { y[i] = 0; }
+        for(int k = 0; k < K; ++k) {
+          float * yk = y + k * OR * OC;
+          for(int d = 0; d < D; ++d) {
+            const float * xd = x + d * R * C;
+            const float * wkd = w + (k * D + d) * KR * KC;
+            for(int i = SX; i < I_END; ++i) { // interior, branch-free
+              float * y_row = yk + (i - OFF_X) * OC;
+              const float * x_row = xd + (i - SX) * C;
+              for(int j = SY; j < J_END; ++j) {
+                float sum = 0;
+                for(int a = 0; a < KR; ++a) {
+                  for(int c = 0; c < KC; ++c) { sum += wkd[a * KC + c] * x_row[a * C + j - SY + c]; }
+                }
+                y_row[j - OFF_Y] += sum;
+              }
+            }
+            if (SAME) { // image edges
+              for(int i = 0; i < R; ++i) {
+                for(int j = 0; j < C; ++j) {
+                  if ((i >= SX) && (i < I_END) && (j >= SY) && (j < J_END)) { continue; }
+                  float sum = 0;
+                  for(int a = 0; a < KR; ++a) {
+                    int ii = i - SX + a;
+                    if ((ii < 0) || (ii >= R)) { continue; }
+                    for(int c = 0; c < KC; ++c) {
+                      int jj = j - SY + c;
+                      if ((jj < 0) || (jj >= C)) { continue; }
+                      sum += wkd[a * KC + c] * xd[ii * C + jj];
+                    }
+                  }
+                  yk[i * OC + j] += sum;
+                }
+              }
+            }
+          }
+          for(int i = 0; i < OR * OC; ++i) { yk[i] += b[k]; }
+        }
+      }
+    };
+
+    // y[OUT], x[IN], w[IN][OUT], b[OUT]
+    template <int IN, int OUT>
+    struct Dense {
+      static constexpr int size = OUT;
+
+      static void compute(const float * __restrict x, float * __restrict y,
+                          const float * __restrict w, const float * __restrict b)
+      {
+        for(int o = 0; o < OUT; ++o) { y[o] = 0; }
+        for(int i = 0; i < IN; ++i) {
+          const float p = x[i];
+          const float * wi = w + i * OUT;
+          for(int o = 0; o < OUT; ++o) { y[o] += wi[o] * p; }
+        }
+        for(int o = 0; o < OUT; ++o) { y[o] += b[o]; }
+      }
+    };
+
+    // y[OUT], x[IN], non-zero weights in CSR format: weights of input i are
+    // [row_ptr[i], row_ptr[i+1]) in idx (neuron index) and val (value), b[OUT]
+    template <int IN, int OUT>
+    struct SparseDense {
+      static constexpr int size = OUT;
+
+      static void compute(const float * __restrict x, float * __restrict y,
+                          const int * row_ptr, const int * idx,
+                          const float * __restrict val, const float * __restrict b)
+      {
+        for(int o = 0; o < OUT; ++o) { y[o] = 0; }
+        for(int i = 0; i < IN; ++i) {
+          const float p = x[i];
+          if (p == 0) { continue; }
+          for(int k = row_ptr[i]; k < row_ptr[i + 1]; ++k) { y[idx[k]] += val[k] * p; }
+        }
+        for(int o = 0; o < OUT; ++o) { y[o] += b[o]; }
+      }
+    };
+
+    // y[D][R/PX][C/PY], x[D][R][C]
+    template <int D, int R, int C, int PX, int PY>
+    struct MaxPooling {
+      static constexpr int OR = R / PX, OC = C / PY;
+      static constexpr int size = D * OR * OC;
+
+      static void compute(const float * __restrict x, float * __restrict y)
+      {
+        for(int d = 0; d < D; ++d) {
+          const float * xd = x + d * R * C;
+          float * yd = y + d * OR * OC;
+          for(int i = 0; i < OR; ++i) {
+            for(int j = 0; j < OC; ++j) {
+              const float * p = xd + i * PX * C + j * PY;
+              float m = p[0];
+              for(int a = 0; a < PX; ++a) {
+                for(int c = 0; c < PY; ++c) { m = (p[a * C + c] > m) ? p[a * C + c] : m; }
+              }
+              yd[i * OC + j] = m;
+            }
+          }
+        }
+      }
+    };
+
+    // activations, in place
+    template <int N> inline void relu(float * x) { for(int i = 0; i < N; ++i) { x[i] = (x[i] < 0) ? 0 : x[i]; } }
+    template <int N> inline void tanh(float * x) { for(int i = 0; i < N; ++i) { x[i] = std::tanh(x[i]); } }
+    template <int N> inline void sigmoid(float * x) { for(int i = 0; i < N; ++i) { x[i] = 1.0F / (1.0F + std::exp(-x[i])); } }
+    template <int N> inline void softmax(float * x)
+    {
+      float sum = 0;
+      for(int i = 0; i < N; ++i) { x[i] = std::exp(x[i]); sum += x[i]; }
+      for(int i = 0; i < N; ++i) { x[i] /= sum; }
+    }
+  }
+}
+
+#endif
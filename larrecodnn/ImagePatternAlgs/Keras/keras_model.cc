@@ -1,9 +1,9 @@
 #include "keras_model.h"
 
-#include "tbb/parallel_for.h"
-
 #include <fstream>
 #include <algorithm>
+#include <chrono>
+#include <iomanip>
 #include <math.h>
 using namespace std;
 
@@ -37,6 +37,171 @@ void keras::DataChunk2D::read_from_file(const std::string &fname) {
 }
 
 
+// Convolution of a single input depth with a single kernel, accumulated in y. Weights w
+// are contiguous and flipped (rows and cols reversed). KR x KC is the kernel size fixed
+// at compile time, so the loops over the kernel are unrolled; KR = KC = 0 is the generic
+// version using the runtime size kr x kc. Pixels where the kernel is entirely inside the
+// image are computed without bound checks, the image edges are done separately (only
+// in the border mode "same", in "valid" mode there is no output for them).
+template <int KR, int KC>
+static void conv_single_depth(
+    std::vector< std::vector<float> > & y, // accumulate here
+    std::vector< std::vector<float> > const & im,
+    const float * w, int kr, int kc, bool same,
+    int o_r0, int o_r1, int o_c0, int o_c1) // region of y to compute: [o_r0, o_r1) x [o_c0, o_c1)
+{
+  const int nr = KR ? KR : kr, nc = KC ? KC : kc;
+  const int st_x = (nr - 1) >> 1, st_y = (nc - 1) >> 1;
+  const int im_rows = im.size(), im_cols = im[0].size();
+  const int off_x = same ? 0 : st_x, off_y = same ? 0 : st_y; // output index = image index - off
+  const int i_end = std::min(im_rows - (nr - 1 - st_x), o_r1 + off_x);
+  const int j_end = std::min(im_cols - (nc - 1 - st_y), o_c1 + off_y);
+  const int i_begin = std::max(st_x, o_r0 + off_x), j_begin = std::max(st_y, o_c0 + off_y);
+
+  const float * rows[KR ? KR : 16];
+  std::vector<const float *> rows_dyn;
+  const float ** r = rows;
+  if (!KR && (nr > 16)) { rows_dyn.resize(nr); r = rows_dyn.data(); }
+
+  for(int i = i_begin; i < i_end; ++i) { // interior, branch-free
+    for(int a = 0; a < nr; ++a) { r[a] = im[i - st_x + a].data(); }
+    float * y_row = y[i - off_x].data();
+    for(int j = j_begin; j < j_end; ++j) {
+      float sum = 0;
+      for(int a = 0; a < nr; ++a) {
+        for(int b = 0; b < nc; ++b) {
+          sum += w[a * nc + b] * r[a][j - st_y + b];
+        }
+      }
+      y_row[j - off_y] += sum;
+    }
+  }
+
+  if (!same) return;
+
+  auto edge = [&](int i, int j) {
+    float sum = 0;
+    for(int a = 0; a < nr; ++a) {
+      int ii = i - st_x + a;
+      if ((ii < 0) || (ii >= im_rows)) continue;
+      for(int b = 0; b < nc; ++b) {
+        int jj = j - st_y + b;
+        if ((jj < 0) || (jj >= im_cols)) continue;
+        sum += w[a * nc + b] * im[ii][jj];
+      }
+    }
+    y[i][j] += sum;
+  };
+  for(int i = o_r0; i < o_r1; ++i) {
+    if ((i < i_begin) || (i >= i_end)) {
+      for(int j = o_c0; j < o_c1; ++j) { edge(i, j); }
+    } else {
+      for(int j = o_c0; j < std::min(j_begin, o_c1); ++j) { edge(i, j); }
+      for(int j = std::max(j_end, j_begin); j < o_c1; ++j) { edge(i, j); }
+    }
+  }
+}
+
+static std::vector<float> flip_kernel(std::vector< std::vector<float> > const & k)
+{
+  std::vector<float> w;
+  for(auto r = k.rbegin(); r != k.rend(); ++r) { w.insert(w.end(), r->rbegin(), r->rend()); }
+  return w;
+}
+
+static keras::LayerConv2D::conv_fn select_conv(int rows, int cols)
+{
+  if ((rows == 1) && (cols == 1)) return conv_single_depth<1, 1>;
+  else if ((rows == 3) && (cols == 3)) return conv_single_depth<3, 3>;
+  else if ((rows == 5) && (cols == 5)) return conv_single_depth<5, 5>;
+  else return conv_single_depth<0, 0>;
+}
+
+// Convolution with strides, w flipped as in conv_single_depth; pad_x, pad_y: zero padding
+// at the top and left (none in border mode "valid").
+static void conv_single_depth_strided(
+    std::vector< std::vector<float> > & y, // accumulate here
+    std::vector< std::vector<float> > const & im,
+    const float * w, int kr, int kc, int sx, int sy, int pad_x, int pad_y)
+{
+  const int im_rows = im.size(), im_cols = im[0].size();
+  for(size_t o = 0; o < y.size(); ++o) {
+    for(size_t p = 0; p < y[o].size(); ++p) {
+      float sum = 0;
+      for(int a = 0; a < kr; ++a) {
+        int ii = o * sx - pad_x + a;
+        if ((ii < 0) || (ii >= im_rows)) continue;
+        for(int b = 0; b < kc; ++b) {
+          int jj = p * sy - pad_y + b;
+          if ((jj < 0) || (jj >= im_cols)) continue;
+          sum += w[a * kc + b] * im[ii][jj];
+        }
+      }
+      y[o][p] += sum;
+    }
+  }
+}
+
+// Output size and zero padding at the beginning of one dimension, padding as in Keras
+// (Tensorflow) in the border mode "same".
+static void conv_output_size(int size, int k, int stride, bool same, size_t & out, int & pad)
+{
+  if (same) {
+    out = (size + stride - 1) / stride;
+    pad = std::max<int>((out - 1) * stride + k - size, 0) / 2;
+  }
+  else {
+    out = (size - k) / stride + 1;
+    pad = 0;
+  }
+}
+
+// Optional strides following the border mode in conv layer header, 1 if not given.
+static void read_strides(std::ifstream &fin, int & sx, int & sy)
+{
+  sx = sy = 1;
+  fin >> std::ws;
+  if (isdigit(fin.peek())) { fin >> sx >> sy; }
+}
+
+// Winograd F(2x2, 3x3): 2x2 outputs of a 3x3 kernel from a 4x4 input tile d, with
+// y = At [ (G w Gt) * (Bt d B) ] A, see Lavin & Gray, arXiv:1509.09308. Kernel weights w
+// are transformed when the model is loaded, the input tiles once per layer evaluation
+// and then they are shared by all kernels.
+static void winograd_kernel_transform(const float * w, float * u) // w: 3x3 flipped, u: 4x4
+{
+  float t[4][3]; // G w
+  for(int c = 0; c < 3; ++c) {
+    t[0][c] = w[c];
+    t[1][c] = 0.5F * (w[c] + w[3 + c] + w[6 + c]);
+    t[2][c] = 0.5F * (w[c] - w[3 + c] + w[6 + c]);
+    t[3][c] = w[6 + c];
+  }
+  for(int r = 0; r < 4; ++r) { // (G w) Gt
+    u[4 * r] = t[r][0];
+    u[4 * r + 1] = 0.5F * (t[r][0] + t[r][1] + t[r][2]);
+    u[4 * r + 2] = 0.5F * (t[r][0] - t[r][1] + t[r][2]);
+    u[4 * r + 3] = t[r][2];
+  }
+}
+
+static void winograd_input_transform(const float d[4][4], float * v) // v: 4x4
+{
+  float t[4][4]; // Bt d
+  for(int c = 0; c < 4; ++c) {
+    t[0][c] = d[0][c] - d[2][c];
+    t[1][c] = d[1][c] + d[2][c];
+    t[2][c] = d[2][c] - d[1][c];
+    t[3][c] = d[1][c] - d[3][c];
+  }
+  for(int r = 0; r < 4; ++r) { // (Bt d) B
+    v[4 * r] = t[r][0] - t[r][2];
+    v[4 * r + 1] = t[r][1] + t[r][2];
+    v[4 * r + 2] = t[r][2] - t[r][1];
+    v[4 * r + 3] = t[r][1] - t[r][3];
+  }
+}
+
 void keras::LayerConv2D::load_weights(std::ifstream &fin) {
   char tmp_char = ' ';
   string tmp_str = "";
@@ -44,9 +209,11 @@ void keras::LayerConv2D::load_weights(std::ifstream &fin) {
   bool skip = false;
   fin >> m_kernels_cnt >> m_depth >> m_rows >> m_cols >> m_border_mode;
   if (m_border_mode == "[") { m_border_mode = "valid"; skip = true; }
+  else { read_strides(fin, m_stride_x, m_stride_y); }
 
   cout << "LayerConv2D " << m_kernels_cnt
-    << "x" << m_depth << "x" << m_rows << "x" << m_cols << " border_mode " << m_border_mode << endl;
+    << "x" << m_depth << "x" << m_rows << "x" << m_cols << " border_mode " << m_border_mode
+    << " strides " << m_stride_x << "x" << m_stride_y << endl;
   // reading kernel weights
   for(int k = 0; k < m_kernels_cnt; ++k) {
     vector<vector<vector<float> > > tmp_depths;
@@ -76,6 +243,30 @@ void keras::LayerConv2D::load_weights(std::ifstream &fin) {
   }
   fin >> tmp_char; // for ']'
 
+  prepare();
+}
+
+// kernels in the layout used in computations, selection of the convolution code
+void keras::LayerConv2D::prepare() {
+  m_flipped.clear();
+  for(auto const & kernel : m_kernels) {
+    for(auto const & k : kernel) {
+      auto w = flip_kernel(k);
+      m_flipped.insert(m_flipped.end(), w.begin(), w.end());
+    }
+  }
+
+  m_conv = select_conv(m_rows, m_cols);
+
+  m_winograd.clear();
+  if ((m_rows == 3) && (m_cols == 3) && (m_stride_x == 1) && (m_stride_y == 1) &&
+      (m_winograd_min_depth >= 0) && (m_depth >= m_winograd_min_depth)) {
+    m_winograd.resize(m_flipped.size() / 9 * 16);
+    for(size_t i = 0; i < m_flipped.size() / 9; ++i) {
+      winograd_kernel_transform(m_flipped.data() + 9 * i, m_winograd.data() + 16 * i);
+    }
+    cout << "LayerConv2D uses Winograd F(2x2,3x3)" << endl;
+  }
 }
 
 void keras::LayerActivation::load_weights(std::ifstream &fin) {
@@ -113,25 +304,41 @@ void keras::LayerDense::load_weights(std::ifstream &fin) {
 
 }
 
-keras::KerasModel::KerasModel(const string &input_fname) {
+void keras::LayerSparseDense::load_weights(std::ifstream &fin) {
+  int nnz = 0;
+  char tmp_char = ' ';
+  fin >> m_input_cnt >> m_neurons >> nnz;
+  m_row_ptr.resize(m_input_cnt + 1);
+  m_neuron_idx.resize(nnz);
+  fin >> tmp_char; // for '['
+  for (auto & v : m_row_ptr) fin >> v;
+  fin >> tmp_char; // for ']'
+  fin >> tmp_char; // for '['
+  for (auto & v : m_neuron_idx) fin >> v;
+  fin >> tmp_char; // for ']'
+  m_values = keras::read_1d_array(fin, nnz);
+  m_bias = keras::read_1d_array(fin, m_neurons);
+  cout << "SparseDense " << m_input_cnt << "x" << m_neurons << ", non-zero weights " << nnz << endl;
+}
+
+keras::KerasModel::KerasModel(const string &input_fname, int winograd_min_depth, int sparse_conv_layers)
+  : m_winograd_min_depth(winograd_min_depth), m_sparse_conv_layers(sparse_conv_layers) {
   load_weights(input_fname);
 }
 
 
 keras::DataChunk* keras::LayerFlatten::compute_output(keras::DataChunk* dc) {
-  vector<vector<vector<float> > > im = dc->get_3d();
+  auto const & im = dc->get_3d(); // no copy, just read rows into the flat output
 
   size_t csize = im[0].size();
   size_t rsize = im[0][0].size();
   size_t size = im.size() * csize * rsize;
   keras::DataChunkFlat *out = new DataChunkFlat(size);
   float * y_ret = out->get_1d_rw().data();
-  for(size_t i = 0, dst = 0; i < im.size(); ++i) {
+  for(size_t i = 0; i < im.size(); ++i) {
     for(size_t j = 0; j < csize; ++j) {
-      float * row = im[i][j].data();
-      for(size_t k = 0; k < rsize; ++k) {
-        y_ret[dst++] = row[k];
-      }
+      std::copy(im[i][j].begin(), im[i][j].end(), y_ret);
+      y_ret += rsize;
     }
   }
 
@@ -139,36 +346,79 @@ keras::DataChunk* keras::LayerFlatten::compute_output(keras::DataChunk* dc) {
 }
 
 
+// running max over pool_x x pool_y windows, unrolled for the fixed-size pools
+template <int PX, int PY>
+static void max_pool_fixed(
+    std::vector< std::vector<float> > & y,
+    std::vector< std::vector<float> > const & im)
+{
+  for(size_t x = 0; x < y.size(); ++x) {
+    float * y_row = y[x].data();
+    const float * rows[PX];
+    for(int i = 0; i < PX; ++i) { rows[i] = im[x*PX + i].data(); }
+    for(size_t j = 0, c = 0; j < y[x].size(); ++j, c += PY) {
+      float m = rows[0][c];
+      for(int i = 0; i < PX; ++i) {
+        for(int k = 0; k < PY; ++k) {
+          if (rows[i][c+k] > m) m = rows[i][c+k];
+        }
+      }
+      y_row[j] = m;
+    }
+  }
+}
+
+static void max_pool_any(
+    std::vector< std::vector<float> > & y,
+    std::vector< std::vector<float> > const & im,
+    unsigned int px, unsigned int py)
+{
+  for(size_t x = 0; x < y.size(); ++x) {
+    float * y_row = y[x].data();
+    for(size_t j = 0, c = 0; j < y[x].size(); ++j, c += py) {
+      float m = im[x*px][c];
+      for(unsigned int i = x*px; i < x*px + px; ++i) {
+        const float * im_row = im[i].data();
+        for(unsigned int k = c; k < c + py; ++k) {
+          if (im_row[k] > m) m = im_row[k];
+        }
+      }
+      y_row[j] = m;
+    }
+  }
+}
+
 keras::DataChunk* keras::LayerMaxPooling::compute_output(keras::DataChunk* dc) {
-  vector<vector<vector<float> > > im = dc->get_3d();
-  vector<vector<vector<float> > > y_ret;
-  for(unsigned int i = 0; i < im.size(); ++i) {
-    vector<vector<float> > tmp_y;
-    for(unsigned int j = 0; j < (unsigned int)(im[0].size()/m_pool_x); ++j) {
-      tmp_y.push_back(vector<float>((int)(im[0][0].size()/m_pool_y), 0.0));
-    }
-    y_ret.push_back(tmp_y);
-  }
-  for(unsigned int d = 0; d < y_ret.size(); ++d) {
-    for(unsigned int x = 0; x < y_ret[0].size(); ++x) {
-      unsigned int start_x = x*m_pool_x;
-      unsigned int end_x = start_x + m_pool_x;
-      for(unsigned int y = 0; y < y_ret[0][0].size(); ++y) {
-        unsigned int start_y = y*m_pool_y;
-        unsigned int end_y = start_y + m_pool_y;
-
-        vector<float> values;
-        for(unsigned int i = start_x; i < end_x; ++i) {
-          for(unsigned int j = start_y; j < end_y; ++j) {
-            values.push_back(im[d][i][j]);
-          }
+  auto const & im = dc->get_3d();
+
+  size_t size_x = im[0].size() / m_pool_x;
+  size_t size_y = im[0][0].size() / m_pool_y;
+
+  keras::DataChunk2D *out = new keras::DataChunk2D(im.size(), size_x, size_y, 0);
+  auto & y_ret = out->get_3d_rw();
+
+  for(size_t d = 0; d < y_ret.size(); ++d) {
+    if ((m_pool_x == 2) && (m_pool_y == 2)) max_pool_fixed<2, 2>(y_ret[d], im[d]);
+    else if ((m_pool_x == 3) && (m_pool_y == 3)) max_pool_fixed<3, 3>(y_ret[d], im[d]);
+    else max_pool_any(y_ret[d], im[d], m_pool_x, m_pool_y);
+  }
+
+  auto const * in2d = dynamic_cast<keras::DataChunk2D const *>(dc);
+  if (in2d && !in2d->m_active.empty()) { // output tile is active if any of its input tiles is
+    const size_t T = keras::DataChunk2D::tile_size;
+    out->m_tile_rows = (size_x + T - 1) / T;
+    out->m_tile_cols = (size_y + T - 1) / T;
+    out->m_active.assign(out->m_tile_rows * out->m_tile_cols, 0);
+    out->m_background = in2d->m_background;
+    for(size_t r = 0; r < in2d->m_tile_rows; ++r) {
+      for(size_t c = 0; c < in2d->m_tile_cols; ++c) {
+        size_t tr = r / m_pool_x, tc = c / m_pool_y;
+        if (in2d->m_active[r * in2d->m_tile_cols + c] && (tr < out->m_tile_rows) && (tc < out->m_tile_cols)) {
+          out->m_active[tr * out->m_tile_cols + tc] = 1;
         }
-        y_ret[d][x][y] = *max_element(values.begin(), values.end());
       }
     }
   }
-  keras::DataChunk *out = new keras::DataChunk2D();
-  out->set_data(y_ret);
   return out;
 }
 
@@ -181,33 +431,30 @@ void keras::missing_activation_impl(const string &act) {
 keras::DataChunk* keras::LayerActivation::compute_output(keras::DataChunk* dc) {
 
   if (dc->get_data_dim() == 3) {
-    vector<vector<vector<float> > > y = dc->get_3d();
+    auto & y = dc->get_3d_rw();
+    auto * dc2d = dynamic_cast<keras::DataChunk2D*>(dc); // background of sparse data, if any
+    std::vector<float> no_bg, & bg = dc2d ? dc2d->m_background : no_bg;
     if(m_activation_type == "relu") {
-      for(unsigned int i = 0; i < y.size(); ++i) {
-        for(unsigned int j = 0; j < y[0].size(); ++j) {
-          for(unsigned int k = 0; k < y[0][0].size(); ++k) {
-            if(y[i][j][k] < 0) y[i][j][k] = 0;
-          }
+      for(auto & depth : y) {
+        for(auto & row : depth) {
+          for(auto & v : row) { if(v < 0) v = 0; }
         }
       }
+      for(auto & v : bg) { if(v < 0) v = 0; }
     } else if(m_activation_type == "tanh") {
-      for(unsigned int i = 0; i < y.size(); ++i) {
-        for(unsigned int j = 0; j < y[0].size(); ++j) {
-          for(unsigned int k = 0; k < y[0][0].size(); ++k) {
-            y[i][j][k] = tanh(y[i][j][k]);
-          }
+      for(auto & depth : y) {
+        for(auto & row : depth) {
+          for(auto & v : row) { v = tanh(v); }
         }
       }
+      for(auto & v : bg) { v = tanh(v); }
     } else {
       keras::missing_activation_impl(m_activation_type);
     }
-
-    keras::DataChunk *out = new keras::DataChunk2D();
-    out->set_data(y);
-    return out;
+    return dc;
 
   } else if (dc->get_data_dim() == 1) { // flat data, use 1D
-    vector<float> y = dc->get_1d();
+    auto & y = dc->get_1d_rw();
     if(m_activation_type == "relu") {
       for(unsigned int k = 0; k < y.size(); ++k) {
         if(y[k] < 0) y[k] = 0;
@@ -232,10 +479,7 @@ keras::DataChunk* keras::LayerActivation::compute_output(keras::DataChunk* dc) {
     } else {
       keras::missing_activation_impl(m_activation_type);
     }
-
-    keras::DataChunk *out = new DataChunkFlat();
-    out->set_data(y);
-    return out;
+    return dc;
 
   } else { throw "data dim not supported"; }
 
@@ -248,25 +492,8 @@ void keras::conv_single_depth_valid(
 	std::vector< std::vector<float> > const & im,
 	std::vector< std::vector<float> > const & k)
 {
-  size_t k1_size = k.size(), k2_size = k[0].size();
-  unsigned int st_x = (k1_size - 1) >> 1;
-  unsigned int st_y = (k2_size - 1) >> 1;
-
-  for(unsigned int i = st_x; i < im.size()-st_x; ++i) {
-    for(unsigned int j = st_y; j < im[0].size()-st_y; ++j) {
-
-      float sum = 0;
-      for(unsigned int k1 = 0; k1 < k1_size; ++k1) {
-        //const float * k_data = k[k1_size-k1-1].data();
-        //const float * im_data = im[i-st_x+k1].data();
-        for(unsigned int k2 = 0; k2 < k2_size; ++k2) {
-          //sum += k_data[k2_size-k2-1] * im_data[j-st_y+k2];
-          sum += k[k1_size-k1-1][k2_size-k2-1] * im[i-st_x+k1][j-st_y+k2];
-        }
-      }
-      y[i-st_x][j-st_y] += sum;
-    }
-  }
+  conv_single_depth<0, 0>(y, im, flip_kernel(k).data(), k.size(), k[0].size(), false,
+                          0, y.size(), 0, y[0].size());
 }
 
 // with border mode = same
@@ -275,36 +502,113 @@ void keras::conv_single_depth_same(
 	std::vector< std::vector<float> > const & im,
 	std::vector< std::vector<float> > const & k)
 {
-  size_t k1_size = k.size(), k2_size = k[0].size();
-  unsigned int st_x = (k1_size - 1) >> 1;
-  unsigned int st_y = (k2_size - 1) >> 1;
-
-  size_t max_imc = im.size() - 1;
-  size_t max_imr = im[0].size() - 1;
+  conv_single_depth<0, 0>(y, im, flip_kernel(k).data(), k.size(), k[0].size(), true,
+                          0, y.size(), 0, y[0].size());
+}
 
-  for(unsigned int i = 0; i < im.size(); ++i) {
-    for(unsigned int j = 0; j < im[0].size(); ++j) {
+// Tiles of the image with any non-zero value, background is zero.
+void keras::DataChunk2D::find_active_tiles(std::vector<std::vector<std::vector<float> > > const & data) {
+  size_t rows = data[0].size(), cols = data[0][0].size();
+  m_tile_rows = (rows + tile_size - 1) / tile_size;
+  m_tile_cols = (cols + tile_size - 1) / tile_size;
+  m_active.assign(m_tile_rows * m_tile_cols, 0);
+  m_background.assign(data.size(), 0.0F);
+  for(auto const & depth : data) {
+    for(size_t r = 0; r < rows; ++r) {
+      char * act = m_active.data() + (r / tile_size) * m_tile_cols;
+      const float * row = depth[r].data();
+      for(size_t c = 0; c < cols; ++c) {
+        if (row[c] != 0) act[c / tile_size] = 1;
+      }
+    }
+  }
+}
 
-      float sum = 0;
-      for(unsigned int k1 = 0; k1 < k1_size; ++k1) {
-        //const float * k_data = k[k1_size-k1-1].data();
-        //const float * im_data = im[i-st_x+k1].data();
-        for(unsigned int k2 = 0; k2 < k2_size; ++k2) {
-          if(i+k1 < st_x) continue;
-          if(i+k1 > max_imc+st_x) continue;
-          if(j+k2 < st_y) continue;
-          if(j+k2 > max_imr+st_y) continue;
-
-          //sum += k_data[k2_size-k2-1] * im_data[j-st_y+k2];
-          sum += k[k1_size-k1-1][k2_size-k2-1] * im[i-st_x+k1][j-st_y+k2];
+// Output tiles of the conv layer that have to be computed: receptive field of the tile
+// contains an active input tile, or the zero padding at the image edge (if the input
+// background is not zero). Other output tiles are the background (bias, if the input
+// background is zero).
+void keras::LayerConv2D::find_active_tiles(keras::DataChunk2D const & in, int rows, int cols, keras::DataChunk2D & out) const {
+  const int T = keras::DataChunk2D::tile_size;
+  int size_x = out.data[0].size(), size_y = out.data[0][0].size();
+  int st_x = (m_rows - 1) >> 1, st_y = (m_cols - 1) >> 1;
+  int off_x = (m_border_mode == "valid") ? st_x : 0, off_y = (m_border_mode == "valid") ? st_y : 0;
+
+  bool zero_bg = true;
+  for(float b : in.m_background) { if (b != 0) zero_bg = false; }
+
+  out.m_tile_rows = (size_x + T - 1) / T;
+  out.m_tile_cols = (size_y + T - 1) / T;
+  out.m_active.assign(out.m_tile_rows * out.m_tile_cols, 0);
+  for(size_t tr = 0; tr < out.m_tile_rows; ++tr) {
+    // input rows seen by the output tile
+    int r0 = tr * T + off_x - st_x;
+    int r1 = std::min<int>((tr + 1) * T, size_x) - 1 + off_x + (m_rows - 1 - st_x);
+    for(size_t tc = 0; tc < out.m_tile_cols; ++tc) {
+      int c0 = tc * T + off_y - st_y;
+      int c1 = std::min<int>((tc + 1) * T, size_y) - 1 + off_y + (m_cols - 1 - st_y);
+      char & act = out.m_active[tr * out.m_tile_cols + tc];
+      if (!zero_bg && ((r0 < 0) || (c0 < 0) || (r1 >= rows) || (c1 >= cols))) { act = 1; continue; }
+      for(int ir = std::max(r0, 0) / T; !act && (ir <= std::min(r1, rows - 1) / T); ++ir) {
+        for(int ic = std::max(c0, 0) / T; ic <= std::min(c1, cols - 1) / T; ++ic) {
+          if (in.m_active[ir * in.m_tile_cols + ic]) { act = 1; break; }
         }
       }
-      y[i][j] += sum;
     }
   }
+
+  out.m_background.resize(m_kernels_cnt);
+  for(int k = 0; k < m_kernels_cnt; ++k) { // bias + background convolved with the kernel
+    float sum = 0;
+    for(int d = 0; d < m_depth; ++d) {
+      if (in.m_background[d] == 0) continue;
+      const float * w = m_flipped.data() + (k * m_depth + d) * m_rows * m_cols;
+      for(int i = 0; i < m_rows * m_cols; ++i) { sum += w[i] * in.m_background[d]; }
+    }
+    out.m_background[k] = m_bias[k] + sum;
+  }
+}
+
+keras::DataChunk* keras::LayerConv2D::compute_output_strided(keras::DataChunk* dc) {
+  auto const & im = dc->get_3d();
+  bool same = (m_border_mode != "valid");
+  size_t size_x, size_y;
+  int pad_x, pad_y;
+  conv_output_size(im[0].size(), m_rows, m_stride_x, same, size_x, pad_x);
+  conv_output_size(im[0][0].size(), m_cols, m_stride_y, same, size_y, pad_y);
+
+  keras::DataChunk2D *out = new keras::DataChunk2D(m_kernels.size(), size_x, size_y, 0);
+  auto & y_ret = out->get_3d_rw();
+
+  parallel_loop( size_t(m_kernels.size()), [&]( size_t j ) {
+      for(unsigned int m = 0; m < im.size(); ++m) { // loop over image depth
+        const float * w = m_flipped.data() + (j * m_depth + m) * m_rows * m_cols;
+        conv_single_depth_strided(y_ret[j], im[m], w, m_rows, m_cols, m_stride_x, m_stride_y, pad_x, pad_y);
+      }
+      for(auto & row : y_ret[j]) {
+        for(auto & v : row) v += m_bias[j];
+      }
+    });
+  return out;
+}
+
+bool keras::LayerConv2D::fold_batch_norm(std::vector<float> const & scale, std::vector<float> const & shift) {
+  if ((int)scale.size() != m_kernels_cnt) return false;
+  for(int k = 0; k < m_kernels_cnt; ++k) {
+    for(auto & depth : m_kernels[k]) {
+      for(auto & row : depth) {
+        for(auto & v : row) v *= scale[k];
+      }
+    }
+    m_bias[k] = m_bias[k] * scale[k] + shift[k];
+  }
+  prepare();
+  return true;
 }
 
 keras::DataChunk* keras::LayerConv2D::compute_output(keras::DataChunk* dc) {
+  if ((m_stride_x != 1) || (m_stride_y != 1)) return compute_output_strided(dc);
+
   unsigned int st_x = (m_kernels[0][0].size()-1) >> 1;
   unsigned int st_y = (m_kernels[0][0][0].size()-1) >> 1;
   auto const & im = dc->get_3d();
@@ -316,16 +620,103 @@ keras::DataChunk* keras::LayerConv2D::compute_output(keras::DataChunk* dc) {
   keras::DataChunk2D *out = new keras::DataChunk2D(m_kernels.size(), size_x, size_y, 0);
   auto & y_ret = out->get_3d_rw();
 
-  //auto t1 = std::chrono::high_resolution_clock::now();
+  bool same = (m_border_mode != "valid");
+  size_t k_size = m_rows * m_cols;
+
+  // sparse mode: output tiles which see only the input background are not computed
+  const size_t T = keras::DataChunk2D::tile_size;
+  auto const * in2d = m_sparse ? dynamic_cast<keras::DataChunk2D const *>(dc) : 0;
+  if (in2d) {
+    keras::DataChunk2D in_tiles; // tiles found here if not known from the preceding layers
+    if (in2d->m_active.empty()) in_tiles.find_active_tiles(im);
+    find_active_tiles(in2d->m_active.empty() ? in_tiles : *in2d, im[0].size(), im[0][0].size(), *out);
+  }
+  const std::vector<char> & active = out->m_active;
+  auto is_active = [&](size_t x, size_t y) {
+    return active.empty() || active[(x / T) * out->m_tile_cols + y / T];
+  };
+
+  // Winograd: transformed input tiles, 2x2 outputs each: tile, depth, 4x4
+  size_t tiles_x = (size_x + 1) / 2, tiles_y = (size_y + 1) / 2;
+  std::vector<float> v;
+  if (!m_winograd.empty()) {
+    int rows = im[0].size(), cols = im[0][0].size();
+    int off = same ? -1 : 0; // image index of the top left input of output 0
+    v.resize(tiles_x * tiles_y * im.size() * 16);
+    parallel_loop( tiles_x, [&]( size_t tx ) {
+        float d[4][4];
+        for(size_t ty = 0; ty < tiles_y; ++ty) {
+          if (!is_active(2 * tx, 2 * ty)) continue;
+          int r0 = 2 * tx + off, c0 = 2 * ty + off;
+          bool inside = (r0 >= 0) && (c0 >= 0) && (r0 + 4 <= rows) && (c0 + 4 <= cols);
+          for(size_t m = 0; m < im.size(); ++m) {
+            for(int r = 0; r < 4; ++r) {
+              for(int c = 0; c < 4; ++c) {
+                int ir = r0 + r, ic = c0 + c;
+                d[r][c] = (inside || ((ir >= 0) && (ir < rows) && (ic >= 0) && (ic < cols))) ? im[m][ir][ic] : 0.0F;
+              }
+            }
+            winograd_input_transform(d, v.data() + ((tx * tiles_y + ty) * im.size() + m) * 16);
+          }
+        }
+      });
+  }
 
   // Parallelize the kernal calculation
-  tbb::parallel_for( size_t(0), size_t(m_kernels.size()), [&]( size_t j ) {
+  parallel_loop( size_t(m_kernels.size()), [&]( size_t j ) {
+
+      if (!m_winograd.empty()) {
+        size_t n = im.size() * 16;
+        const float * u = m_winograd.data() + j * n;
+        for(size_t tx = 0; tx < tiles_x; ++tx) {
+          for(size_t ty = 0; ty < tiles_y; ++ty) {
+            if (!is_active(2 * tx, 2 * ty)) continue;
+            const float * vt = v.data() + (tx * tiles_y + ty) * n;
+            float p[16] = {0};
+            for(size_t m = 0; m < n; m += 16) { // sum of elementwise products over depth
+              for(size_t e = 0; e < 16; ++e) { p[e] += u[m + e] * vt[m + e]; }
+            }
+            float t[2][4]; // At p
+            for(int c = 0; c < 4; ++c) {
+              t[0][c] = p[c] + p[4 + c] + p[8 + c];
+              t[1][c] = p[4 + c] - p[8 + c] - p[12 + c];
+            }
+            size_t x = 2 * tx, y = 2 * ty;
+            for(size_t r = 0; (r < 2) && (x + r < size_x); ++r) { // (At p) A
+              y_ret[j][x + r][y] += t[r][0] + t[r][1] + t[r][2];
+              if (y + 1 < size_y) y_ret[j][x + r][y + 1] += t[r][1] - t[r][2] - t[r][3];
+            }
+          }
+        }
+      }
+      else {
+        for(unsigned int m = 0; m < im.size(); ++m) { // loop over image depth
+          const float * w = m_flipped.data() + (j * m_depth + m) * k_size;
+          if (active.empty()) {
+            m_conv(y_ret[j], im[m], w, m_rows, m_cols, same, 0, size_x, 0, size_y);
+            continue;
+          }
+          for(size_t tr = 0; tr < out->m_tile_rows; ++tr) { // spans of active tiles in each row
+            const char * act = active.data() + tr * out->m_tile_cols;
+            for(size_t tc = 0; tc < out->m_tile_cols; ) {
+              if (!act[tc]) { ++tc; continue; }
+              size_t tc_end = tc;
+              while ((tc_end < out->m_tile_cols) && act[tc_end]) ++tc_end;
+              m_conv(y_ret[j], im[m], w, m_rows, m_cols, same,
+                     tr * T, std::min((tr + 1) * T, size_x), tc * T, std::min(tc_end * T, size_y));
+              tc = tc_end;
+            }
+          }
+        }
+      }
 
-      for(unsigned int m = 0; m < im.size(); ++m) { // loop over image depth
-	if (m_border_mode == "valid")
-          keras::conv_single_depth_valid(y_ret[j], im[m], m_kernels[j][m]);
-	else
-          keras::conv_single_depth_same(y_ret[j], im[m], m_kernels[j][m]);
+      if (!active.empty()) { // background of the skipped tiles
+        float bg = out->m_background[j] - m_bias[j]; // bias is added below
+        for(size_t x = 0; x < size_x; ++x) {
+          for(size_t y = 0; y < size_y; ++y) {
+            if (!is_active(x, y)) y_ret[j][x][y] = bg;
+          }
+        }
       }
 
       for(unsigned int x = 0; x < y_ret[0].size(); ++x) {
@@ -350,13 +741,6 @@ keras::DataChunk* keras::LayerConv2D::compute_output(keras::DataChunk* dc) {
       }
     });
 
-  //auto t2 = std::chrono::high_resolution_clock::now();
-  /*
-  cout << "Parallal : "
-       << std::chrono::duration_cast<std::chrono::microseconds>(t2-t1).count()
-       << " microseconds." << endl;
-  */
-
   return out;
 }
 
@@ -373,8 +757,9 @@ keras::DataChunk* keras::LayerDense::compute_output(keras::DataChunk* dc) {
   auto const & im = dc->get_1d();
 
   for (size_t j = 0; j < m_weights.size(); ++j) { // iter over input
-    const float * w = m_weights[j].data();
     float p = im[j];
+    if (p == 0) continue; // e.g. after relu, nothing to add
+    const float * w = m_weights[j].data();
     size_t k = 0;
     for (size_t i = 0; i < size8; ++i) { // iter over neurons
       y_ret[k]   += w[k]   * p;          // vectorize if you can
@@ -396,24 +781,313 @@ keras::DataChunk* keras::LayerDense::compute_output(keras::DataChunk* dc) {
   return out;
 }
 
+keras::DataChunk* keras::LayerSparseDense::compute_output(keras::DataChunk* dc) {
+  keras::DataChunkFlat *out = new DataChunkFlat(m_neurons, 0);
+  float * y_ret = out->get_1d_rw().data();
+
+  auto const & im = dc->get_1d();
+
+  for (int j = 0; j < m_input_cnt; ++j) { // iter over input
+    float p = im[j];
+    if (p == 0) continue;
+    for (int k = m_row_ptr[j]; k < m_row_ptr[j+1]; ++k) { // iter over non-zero weights
+      y_ret[m_neuron_idx[k]] += m_values[k] * p;
+    }
+  }
+  for (int i = 0; i < m_neurons; ++i) { // add biases
+    y_ret[i] += m_bias[i];
+  }
+
+  return out;
+}
+
+double keras::LayerConv2D::get_flops(size_t, size_t out_size) const {
+  return 2.0 * out_size * m_depth * m_rows * m_cols; // nominal, as in the direct convolution
+}
+
+size_t keras::LayerConv2D::get_weights_bytes() const {
+  return sizeof(float) * (m_kernels_cnt * m_depth * m_rows * m_cols + m_bias.size());
+}
+
+double keras::LayerSeparableConv2D::get_flops(size_t, size_t out_size) const {
+  double pixels = out_size / m_kernels_cnt;
+  return 2.0 * pixels * m_depth * m_multiplier * (m_rows * m_cols + m_kernels_cnt);
+}
+
+size_t keras::LayerSeparableConv2D::get_weights_bytes() const {
+  return sizeof(float) * (m_depthwise.size() + m_pointwise.size() + m_bias.size());
+}
+
+double keras::LayerDense::get_flops(size_t, size_t) const { return 2.0 * m_input_cnt * m_neurons; }
+
+size_t keras::LayerDense::get_weights_bytes() const {
+  return sizeof(float) * (m_input_cnt + 1) * m_neurons;
+}
+
+double keras::LayerSparseDense::get_flops(size_t, size_t) const { return 2.0 * m_values.size(); }
+
+size_t keras::LayerSparseDense::get_weights_bytes() const {
+  return sizeof(int) * (m_row_ptr.size() + m_neuron_idx.size()) + sizeof(float) * (m_values.size() + m_bias.size());
+}
+
+size_t keras::LayerBatchNorm::get_weights_bytes() const {
+  return sizeof(float) * (m_scale.size() + m_shift.size());
+}
+
+bool keras::LayerDense::fold_batch_norm(std::vector<float> const & scale, std::vector<float> const & shift) {
+  if ((int)scale.size() != m_neurons) return false;
+  for(auto & w : m_weights) {
+    for(int n = 0; n < m_neurons; ++n) w[n] *= scale[n];
+  }
+  for(int n = 0; n < m_neurons; ++n) m_bias[n] = m_bias[n] * scale[n] + shift[n];
+  return true;
+}
+
+bool keras::LayerSparseDense::fold_batch_norm(std::vector<float> const & scale, std::vector<float> const & shift) {
+  if ((int)scale.size() != m_neurons) return false;
+  for(size_t k = 0; k < m_values.size(); ++k) m_values[k] *= scale[m_neuron_idx[k]];
+  for(int n = 0; n < m_neurons; ++n) m_bias[n] = m_bias[n] * scale[n] + shift[n];
+  return true;
+}
+
+void keras::LayerBatchNorm::load_weights(std::ifstream &fin) {
+  int n = 0;
+  float epsilon = 0;
+  fin >> n >> epsilon;
+  auto gamma = keras::read_1d_array(fin, n);
+  auto beta = keras::read_1d_array(fin, n);
+  auto mean = keras::read_1d_array(fin, n);
+  auto var = keras::read_1d_array(fin, n);
+  m_scale.resize(n);
+  m_shift.resize(n);
+  for(int i = 0; i < n; ++i) { // y = gamma * (x - mean) / sqrt(var + epsilon) + beta
+    m_scale[i] = gamma[i] / sqrt(var[i] + epsilon);
+    m_shift[i] = beta[i] - mean[i] * m_scale[i];
+  }
+  cout << "BatchNormalization " << n << endl;
+}
+
+keras::DataChunk* keras::LayerBatchNorm::compute_output(keras::DataChunk* dc) {
+  if (dc->get_data_dim() == 3) { // per depth
+    auto & y = dc->get_3d_rw();
+    for(size_t d = 0; d < y.size(); ++d) {
+      for(auto & row : y[d]) {
+        for(auto & v : row) v = v * m_scale[d] + m_shift[d];
+      }
+    }
+    auto * dc2d = dynamic_cast<keras::DataChunk2D*>(dc);
+    if (dc2d) {
+      for(size_t d = 0; d < dc2d->m_background.size(); ++d) {
+        dc2d->m_background[d] = dc2d->m_background[d] * m_scale[d] + m_shift[d];
+      }
+    }
+  } else if (dc->get_data_dim() == 1) {
+    auto & y = dc->get_1d_rw();
+    for(size_t i = 0; i < y.size(); ++i) y[i] = y[i] * m_scale[i] + m_shift[i];
+  } else { throw "data dim not supported"; }
+  return dc;
+}
+
+keras::DataChunk* keras::LayerGlobalAveragePooling::compute_output(keras::DataChunk* dc) {
+  auto const & im = dc->get_3d();
+  keras::DataChunkFlat *out = new DataChunkFlat(im.size(), 0);
+  auto & y = out->get_1d_rw();
+  for(size_t d = 0; d < im.size(); ++d) {
+    float sum = 0;
+    for(auto const & row : im[d]) {
+      for(float v : row) sum += v;
+    }
+    y[d] = sum / (im[d].size() * im[d][0].size());
+  }
+  return out;
+}
+
+void keras::LayerSeparableConv2D::load_weights(std::ifstream &fin) {
+  fin >> m_kernels_cnt >> m_depth >> m_rows >> m_cols >> m_multiplier >> m_border_mode;
+  read_strides(fin, m_stride_x, m_stride_y);
+  cout << "LayerSeparableConv2D " << m_kernels_cnt << "x" << m_depth << "x" << m_rows << "x" << m_cols
+    << " depth multiplier " << m_multiplier << " border_mode " << m_border_mode
+    << " strides " << m_stride_x << "x" << m_stride_y << endl;
+
+  size_t n_dw = m_depth * m_multiplier;
+  m_depthwise.clear();
+  for(size_t i = 0; i < n_dw * m_rows; ++i) { // kernel rows
+    auto row = keras::read_1d_array(fin, m_cols);
+    m_depthwise.insert(m_depthwise.end(), row.begin(), row.end());
+  }
+  m_pointwise.clear();
+  for(int k = 0; k < m_kernels_cnt; ++k) {
+    auto row = keras::read_1d_array(fin, n_dw);
+    m_pointwise.insert(m_pointwise.end(), row.begin(), row.end());
+  }
+  m_bias = keras::read_1d_array(fin, m_kernels_cnt);
+  m_conv = select_conv(m_rows, m_cols);
+}
+
+keras::DataChunk* keras::LayerSeparableConv2D::compute_output(keras::DataChunk* dc) {
+  auto const & im = dc->get_3d();
+  bool same = (m_border_mode != "valid");
+  bool strided = (m_stride_x != 1) || (m_stride_y != 1);
+  size_t size_x, size_y;
+  int pad_x, pad_y;
+  conv_output_size(im[0].size(), m_rows, m_stride_x, same, size_x, pad_x);
+  conv_output_size(im[0][0].size(), m_cols, m_stride_y, same, size_y, pad_y);
+
+  // depthwise: each input depth d with its m_multiplier kernels, output d * m_multiplier + i
+  size_t n_dw = m_depth * m_multiplier;
+  keras::DataChunk2D dw(n_dw, size_x, size_y, 0);
+  auto & y_dw = dw.get_3d_rw();
+  parallel_loop( n_dw, [&]( size_t c ) {
+      const float * w = m_depthwise.data() + c * m_rows * m_cols;
+      auto const & x = im[c / m_multiplier];
+      if (strided) conv_single_depth_strided(y_dw[c], x, w, m_rows, m_cols, m_stride_x, m_stride_y, pad_x, pad_y);
+      else m_conv(y_dw[c], x, w, m_rows, m_cols, same, 0, size_x, 0, size_y);
+    });
+
+  // pointwise: 1x1 convolution over the depthwise outputs
+  keras::DataChunk2D *out = new keras::DataChunk2D(m_kernels_cnt, size_x, size_y, 0);
+  auto & y_ret = out->get_3d_rw();
+  parallel_loop( size_t(m_kernels_cnt), [&]( size_t k ) {
+      const float * pw = m_pointwise.data() + k * n_dw;
+      for(size_t x = 0; x < size_x; ++x) {
+        float * y = y_ret[k][x].data();
+        for(size_t c = 0; c < n_dw; ++c) {
+          const float * v = y_dw[c][x].data();
+          for(size_t j = 0; j < size_y; ++j) y[j] += pw[c] * v[j];
+        }
+        for(size_t j = 0; j < size_y; ++j) y[j] += m_bias[k];
+      }
+    });
+  return out;
+}
+
+bool keras::LayerSeparableConv2D::fold_batch_norm(std::vector<float> const & scale, std::vector<float> const & shift) {
+  if ((int)scale.size() != m_kernels_cnt) return false;
+  size_t n_dw = m_depth * m_multiplier;
+  for(int k = 0; k < m_kernels_cnt; ++k) {
+    for(size_t c = 0; c < n_dw; ++c) m_pointwise[k * n_dw + c] *= scale[k];
+    m_bias[k] = m_bias[k] * scale[k] + shift[k];
+  }
+  return true;
+}
+
+static size_t chunk_size(keras::DataChunk * dc) {
+  if (dc->get_data_dim() == 1) return dc->get_1d().size();
+  auto const & im = dc->get_3d();
+  return im.size() * im[0].size() * im[0][0].size();
+}
+
+void keras::KerasModel::set_profiling(bool on) {
+  m_profiling = on;
+  reset_profile();
+}
+
+void keras::KerasModel::reset_profile() {
+  std::lock_guard<std::mutex> lock(m_profile_mutex);
+  m_profile.assign(m_layers.size(), LayerProfile());
+  for(size_t l = 0; l < m_layers.size(); ++l) m_profile[l].name = m_layers[l]->get_name();
+}
+
+std::vector<keras::KerasModel::LayerProfile> keras::KerasModel::get_profile() const {
+  std::lock_guard<std::mutex> lock(m_profile_mutex);
+  return m_profile;
+}
+
+void keras::KerasModel::print_profile(std::ostream & os) const {
+  auto prof = get_profile();
+  double total = 0;
+  for(auto const & p : prof) total += p.time_us;
+
+  os << std::left << std::setw(4) << "#" << std::setw(24) << "layer" << std::right
+     << std::setw(10) << "calls" << std::setw(14) << "time [ms]" << std::setw(8) << "[%]"
+     << std::setw(14) << "us/call" << std::setw(14) << "MFLOP/call" << std::setw(12) << "GFLOP/s"
+     << std::setw(14) << "kB/call" << std::endl;
+  os << std::fixed;
+  for(size_t l = 0; l < prof.size(); ++l) {
+    auto const & p = prof[l];
+    double calls = std::max<size_t>(p.calls, 1);
+    os << std::left << std::setw(4) << l << std::setw(24) << p.name << std::right
+       << std::setw(10) << p.calls
+       << std::setw(14) << std::setprecision(2) << 1e-3 * p.time_us
+       << std::setw(8) << std::setprecision(1) << ((total > 0) ? 100 * p.time_us / total : 0)
+       << std::setw(14) << std::setprecision(2) << p.time_us / calls
+       << std::setw(14) << std::setprecision(3) << 1e-6 * p.flops / calls
+       << std::setw(12) << std::setprecision(2) << ((p.time_us > 0) ? 1e-3 * p.flops / p.time_us : 0)
+       << std::setw(14) << std::setprecision(1) << 1e-3 * p.bytes / calls << std::endl;
+  }
+  os << std::defaultfloat;
+}
+
+void keras::KerasModel::set_parallelism(Parallelism p, size_t grain, int arena_threads) {
+  m_parallelism = p;
+  m_grain = std::max<size_t>(grain, 1);
+  for(auto l : m_layers) {
+    l->m_parallel = (p == Parallelism::IntraLayer);
+    l->m_grain = m_grain;
+  }
+  if (arena_threads > 0) m_arena = std::make_unique<tbb::task_arena>(arena_threads);
+  else m_arena.reset();
+}
 
 std::vector<float> keras::KerasModel::compute_output(keras::DataChunk *dc) {
+  if (!m_arena) return compute_sample(dc);
+
+  std::vector<float> out;
+  m_arena->execute([&]() { out = compute_sample(dc); });
+  return out;
+}
+
+std::vector< std::vector<float> > keras::KerasModel::compute_output(std::vector<keras::DataChunk*> const & dcs) {
+  std::vector< std::vector<float> > out(dcs.size());
+  auto run = [&]() {
+    if (m_parallelism == Parallelism::Batch) {
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, dcs.size(), m_grain), [&](tbb::blocked_range<size_t> const & r) {
+          for(size_t i = r.begin(); i != r.end(); ++i) out[i] = compute_sample(dcs[i]);
+        });
+    }
+    else {
+      for(size_t i = 0; i < dcs.size(); ++i) out[i] = compute_sample(dcs[i]);
+    }
+  };
+  if (m_arena) m_arena->execute(run);
+  else run();
+  return out;
+}
+
+std::vector<float> keras::KerasModel::compute_sample(keras::DataChunk *dc) const {
   //cout << endl << "KerasModel compute output" << endl;
   //cout << "Input data size:" << endl;
   //dc->show_name();
 
+  std::vector<LayerProfile> prof; // this sample, added to m_profile at the end
+  if (m_profiling) prof.resize(m_layers.size());
+
   keras::DataChunk *inp = dc;
   keras::DataChunk *out = 0;
   for(int l = 0; l < (int)m_layers.size(); ++l) {
     //cout << "Processing layer " << m_layers[l]->get_name() << endl;
-    out = m_layers[l]->compute_output(inp);
+    if (m_layers[l]->is_in_place() && (inp == dc)) {
+      inp = dc->clone(); // do not modify the caller's input
+    }
+    if (m_profiling) {
+      size_t in_size = chunk_size(inp);
+      auto t1 = std::chrono::steady_clock::now();
+      out = m_layers[l]->compute_output(inp);
+      auto t2 = std::chrono::steady_clock::now();
+      size_t out_size = chunk_size(out);
+      prof[l].time_us = std::chrono::duration<double, std::micro>(t2 - t1).count();
+      prof[l].flops = m_layers[l]->get_flops(in_size, out_size);
+      prof[l].bytes = sizeof(float) * (in_size + out_size) + m_layers[l]->get_weights_bytes();
+      prof[l].calls = 1;
+    }
+    else out = m_layers[l]->compute_output(inp);
 
     //cout << "Input" << endl;
     //inp->show_name();
     //cout << "Output" << endl;
     //out->show_name();
 
-    if (inp != dc) delete inp;
+    if ((inp != dc) && (inp != out)) delete inp;
     inp = 0L;
     inp = out;
   }
@@ -421,8 +1095,18 @@ std::vector<float> keras::KerasModel::compute_output(keras::DataChunk *dc) {
   //cout << "Output: ";
   //out->show_values();
 
-  std::vector<float> flat_out = out->get_1d();
-  delete out;
+  std::vector<float> flat_out = std::move(out->get_1d_rw());
+  if (out != dc) delete out;
+
+  if (m_profiling) {
+    std::lock_guard<std::mutex> lock(m_profile_mutex);
+    for(size_t l = 0; l < prof.size(); ++l) {
+      m_profile[l].time_us += prof[l].time_us;
+      m_profile[l].flops += prof[l].flops;
+      m_profile[l].bytes += prof[l].bytes;
+      m_profile[l].calls += prof[l].calls;
+    }
+  }
 
   return flat_out;
 }
@@ -437,13 +1121,15 @@ void keras::KerasModel::load_weights(const string &input_fname) {
   fin >> tmp_str >> m_layers_cnt;
   cout << "Layers " << m_layers_cnt << endl;
 
+  int conv_layers = 0;
   for(int layer = 0; layer < m_layers_cnt; ++layer) { // iterate over layers
     fin >> tmp_str >> tmp_int >> layer_type;
     cout << "Layer " << tmp_int << " " << layer_type << endl;
 
     Layer *l = 0L;
     if(layer_type == "Convolution2D") {
-      l = new LayerConv2D();
+      l = new LayerConv2D(m_winograd_min_depth);
+      static_cast<LayerConv2D*>(l)->m_sparse = (conv_layers++ < m_sparse_conv_layers);
     } else if(layer_type == "Activation") {
       l = new LayerActivation();
     } else if(layer_type == "MaxPooling2D") {
@@ -452,6 +1138,14 @@ void keras::KerasModel::load_weights(const string &input_fname) {
       l = new LayerFlatten();
     } else if(layer_type == "Dense") {
       l = new LayerDense();
+    } else if(layer_type == "SparseDense") {
+      l = new LayerSparseDense();
+    } else if(layer_type == "SeparableConvolution2D") {
+      l = new LayerSeparableConv2D();
+    } else if(layer_type == "BatchNormalization") {
+      l = new LayerBatchNorm();
+    } else if(layer_type == "GlobalAveragePooling2D") {
+      l = new LayerGlobalAveragePooling();
     } else if(layer_type == "Dropout") {
       continue; // we dont need dropout layer in prediciton mode
     }
@@ -460,6 +1154,13 @@ void keras::KerasModel::load_weights(const string &input_fname) {
       return;
     }
     l->load_weights(fin);
+
+    auto bn = dynamic_cast<LayerBatchNorm*>(l);
+    if (bn && !m_layers.empty() && m_layers.back()->fold_batch_norm(bn->m_scale, bn->m_shift)) {
+      cout << "BatchNormalization folded into " << m_layers.back()->get_name() << endl;
+      delete l;
+      continue;
+    }
     m_layers.push_back(l);
   }
 
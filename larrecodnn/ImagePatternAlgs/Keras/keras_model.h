@@ -16,6 +16,12 @@
 #include <vector>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+#include "tbb/task_arena.h"
 
 namespace keras
 {
@@ -34,6 +40,10 @@ namespace keras
 	class LayerActivation;
 	class LayerConv2D;
 	class LayerDense;
+	class LayerSparseDense;
+	class LayerSeparableConv2D;
+	class LayerBatchNorm;
+	class LayerGlobalAveragePooling;
 
 	class KerasModel;
 }
@@ -44,6 +54,9 @@ public:
   virtual size_t get_data_dim(void) const { return 0; }
   virtual std::vector<float> const & get_1d() const { throw "not implemented"; };
   virtual std::vector<std::vector<std::vector<float> > > const & get_3d() const { throw "not implemented"; };
+  virtual std::vector<float> & get_1d_rw() { throw "not implemented"; };
+  virtual std::vector<std::vector<std::vector<float> > > & get_3d_rw() { throw "not implemented"; };
+  virtual keras::DataChunk* clone() const = 0;
   virtual void set_data(std::vector<std::vector<std::vector<float> > > const &) {};
   virtual void set_data(std::vector<float> const &) {};
   //virtual unsigned int get_count();
@@ -61,7 +74,8 @@ public:
 
   std::vector< std::vector< std::vector<float> > > & get_3d_rw() { return data; };
   std::vector< std::vector< std::vector<float> > > const & get_3d() const { return data; };
-  virtual void set_data(std::vector<std::vector<std::vector<float> > > const & d) { data = d; };
+  keras::DataChunk* clone() const { return new DataChunk2D(*this); }
+  virtual void set_data(std::vector<std::vector<std::vector<float> > > const & d) { data = d; m_active.clear(); };
   size_t get_data_dim(void) const { return 3; }
 
   void show_name() {
@@ -87,9 +101,19 @@ public:
   void read_from_file(const std::string &fname);
   std::vector<std::vector<std::vector<float> > > data; // depth, rows, cols
 
-  int m_depth;
-  int m_rows;
-  int m_cols;
+  // Sparse data: image is divided into tiles of tile_size x tile_size pixels, in inactive
+  // tiles all values of each depth are equal to m_background[depth]. Used to skip the
+  // empty regions in convolutions, m_active is empty if the tiles are not known.
+  static constexpr size_t tile_size = 8;
+  void find_active_tiles(std::vector<std::vector<std::vector<float> > > const & d); // tiles of d with non-zero values
+  std::vector<char> m_active; // tile rows x tile cols, 0 if the tile is background only
+  std::vector<float> m_background;
+  size_t m_tile_rows = 0;
+  size_t m_tile_cols = 0;
+
+  int m_depth = 0;
+  int m_rows = 0;
+  int m_cols = 0;
 };
 
 class keras::DataChunkFlat : public keras::DataChunk {
@@ -101,6 +125,7 @@ public:
   std::vector<float> f;
   std::vector<float> & get_1d_rw() { return f; }
   std::vector<float> const & get_1d() const { return f; }
+  keras::DataChunk* clone() const { return new DataChunkFlat(*this); }
   void set_data(std::vector<float> const & d) { f = d; };
   size_t get_data_dim(void) const { return 1; }
 
@@ -120,6 +145,16 @@ class keras::Layer {
 public:
   virtual void load_weights(std::ifstream &fin) = 0;
   virtual keras::DataChunk* compute_output(keras::DataChunk*) = 0;
+  virtual bool is_in_place() const { return false; } // output is the modified input chunk
+
+  // fold y = scale * x + shift (per output channel, e.g. batch normalization) into the
+  // layer weights; returns false if the layer can not do it
+  virtual bool fold_batch_norm(std::vector<float> const &, std::vector<float> const &) { return false; }
+
+  // estimated cost of one call, used in profiling: floating point operations (nominal, multiply-add
+  // counted as 2), and size of the weights read
+  virtual double get_flops(size_t /*in_size*/, size_t /*out_size*/) const { return 0; }
+  virtual size_t get_weights_bytes() const { return 0; }
 
   Layer(std::string name) : m_name(name) {}
   virtual ~Layer() {}
@@ -130,6 +165,20 @@ public:
 
   std::string get_name() { return m_name; }
   std::string m_name;
+
+  // loops inside the layer (over kernels, tiles) run in parallel if m_parallel is set,
+  // with at least m_grain iterations per task; set by KerasModel::set_parallelism
+  bool m_parallel = true;
+  size_t m_grain = 1;
+
+protected:
+  template <typename F>
+  void parallel_loop(size_t n, F const & f) const {
+    if (!m_parallel) { for(size_t i = 0; i < n; ++i) f(i); return; }
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, n, m_grain), [&](tbb::blocked_range<size_t> const & r) {
+        for(size_t i = r.begin(); i != r.end(); ++i) f(i);
+      });
+  }
 };
 
 
@@ -151,6 +200,7 @@ public:
 
   void load_weights(std::ifstream &fin);
   keras::DataChunk* compute_output(keras::DataChunk*);
+  virtual double get_flops(size_t in_size, size_t) const { return in_size; } // comparisons
 
   virtual unsigned int get_input_rows() const { return 0; } // look for the value in the preceding layer
   virtual unsigned int get_input_cols() const { return 0; } // same as for rows
@@ -165,7 +215,9 @@ class keras::LayerActivation : public Layer {
 public:
   LayerActivation() : Layer("Activation") {}
   void load_weights(std::ifstream &fin);
-  keras::DataChunk* compute_output(keras::DataChunk*);
+  keras::DataChunk* compute_output(keras::DataChunk*); // activation applied to dc in place
+  virtual bool is_in_place() const { return true; }
+  virtual double get_flops(size_t in_size, size_t) const { return in_size; }
 
   virtual unsigned int get_input_rows() const { return 0; } // look for the value in the preceding layer
   virtual unsigned int get_input_cols() const { return 0; } // same as for rows
@@ -176,10 +228,15 @@ public:
 
 class keras::LayerConv2D : public Layer {
 public:
-  LayerConv2D() : Layer("Conv2D") {}
+  LayerConv2D(int winograd_min_depth = -1) : Layer("Conv2D"), m_winograd_min_depth(winograd_min_depth) {}
 
   void load_weights(std::ifstream &fin);
   keras::DataChunk* compute_output(keras::DataChunk*);
+  keras::DataChunk* compute_output_strided(keras::DataChunk*);
+  bool fold_batch_norm(std::vector<float> const & scale, std::vector<float> const & shift);
+  double get_flops(size_t in_size, size_t out_size) const;
+  size_t get_weights_bytes() const;
+  void prepare();
   std::vector<std::vector<std::vector<std::vector<float> > > > m_kernels; // kernel, depth, rows, cols
   std::vector<float> m_bias; // kernel
 
@@ -187,19 +244,101 @@ public:
   virtual unsigned int get_input_cols() const { return m_cols; }
   virtual unsigned int get_output_units() const { return m_kernels_cnt; }
 
+  // convolution of one input depth with one (flipped, contiguous) kernel, specialized for
+  // the kernel size when the model is loaded
+  typedef void (*conv_fn)(std::vector< std::vector<float> > &, std::vector< std::vector<float> > const &,
+                          const float *, int, int, bool, int, int, int, int);
+  conv_fn m_conv = 0;
+  std::vector<float> m_flipped; // kernel, depth, rows, cols with rows and cols reversed
+
+  // Winograd F(2x2,3x3) is used for 3x3 kernels if the input depth is at least
+  // m_winograd_min_depth (negative: never); weights transformed at load: kernel, depth, 4x4
+  int m_winograd_min_depth;
+  std::vector<float> m_winograd;
+
+  // sparse mode: skip tiles of the output which see only the background of the input
+  bool m_sparse = false;
+  void find_active_tiles(keras::DataChunk2D const & in, int rows, int cols, keras::DataChunk2D & out) const;
+
+  std::string m_border_mode;
+  int m_stride_x = 1;
+  int m_stride_y = 1;
+  int m_kernels_cnt;
+  int m_depth;
+  int m_rows;
+  int m_cols;
+};
+
+// Depthwise convolution (m_multiplier kernels for each input depth) followed by 1x1
+// (pointwise) convolution. Kernels are stored as used in computations (not flipped).
+class keras::LayerSeparableConv2D : public Layer {
+public:
+  LayerSeparableConv2D() : Layer("SeparableConv2D") {}
+
+  void load_weights(std::ifstream &fin);
+  keras::DataChunk* compute_output(keras::DataChunk*);
+  bool fold_batch_norm(std::vector<float> const & scale, std::vector<float> const & shift);
+  double get_flops(size_t in_size, size_t out_size) const;
+  size_t get_weights_bytes() const;
+  std::vector<float> m_depthwise; // depth * multiplier, rows, cols
+  std::vector<float> m_pointwise; // kernel, depth * multiplier
+  std::vector<float> m_bias;      // kernel
+  keras::LayerConv2D::conv_fn m_conv = 0;
+
+  virtual unsigned int get_input_rows() const { return m_rows; }
+  virtual unsigned int get_input_cols() const { return m_cols; }
+  virtual unsigned int get_output_units() const { return m_kernels_cnt; }
+
   std::string m_border_mode;
+  int m_stride_x = 1;
+  int m_stride_y = 1;
   int m_kernels_cnt;
   int m_depth;
+  int m_multiplier;
   int m_rows;
   int m_cols;
 };
 
+// Batch normalization, folded into the preceding conv or dense layer when the model is
+// loaded; used as a separate layer only if there is nothing to fold into (e.g. after activation).
+class keras::LayerBatchNorm : public Layer {
+public:
+  LayerBatchNorm() : Layer("BatchNormalization") {}
+  void load_weights(std::ifstream &fin);
+  keras::DataChunk* compute_output(keras::DataChunk*); // applied to dc in place
+  virtual bool is_in_place() const { return true; }
+  virtual double get_flops(size_t in_size, size_t) const { return 2.0 * in_size; }
+  virtual size_t get_weights_bytes() const;
+
+  virtual unsigned int get_input_rows() const { return 0; } // look for the value in the preceding layer
+  virtual unsigned int get_input_cols() const { return 0; } // same as for rows
+  virtual unsigned int get_output_units() const { return 0; }
+
+  std::vector<float> m_scale; // gamma / sqrt(var + epsilon)
+  std::vector<float> m_shift; // beta - mean * scale
+};
+
+class keras::LayerGlobalAveragePooling : public Layer {
+public:
+  LayerGlobalAveragePooling() : Layer("GlobalAveragePooling2D") {}
+  void load_weights(std::ifstream &) {}
+  keras::DataChunk* compute_output(keras::DataChunk*);
+  virtual double get_flops(size_t in_size, size_t) const { return in_size; }
+
+  virtual unsigned int get_input_rows() const { return 0; } // look for the value in the preceding layer
+  virtual unsigned int get_input_cols() const { return 0; } // same as for rows
+  virtual unsigned int get_output_units() const { return 0; }
+};
+
 class keras::LayerDense : public Layer {
 public:
   LayerDense() : Layer("Dense") {}
 
   void load_weights(std::ifstream &fin);
   keras::DataChunk* compute_output(keras::DataChunk*);
+  bool fold_batch_norm(std::vector<float> const & scale, std::vector<float> const & shift);
+  double get_flops(size_t in_size, size_t out_size) const;
+  size_t get_weights_bytes() const;
   std::vector<std::vector<float> > m_weights; //input, neuron
   std::vector<float> m_bias; // neuron
 
@@ -211,11 +350,61 @@ public:
   int m_neurons;
 };
 
+// Dense layer with pruned weights, non-zero weights stored in CSR format (rows are inputs)
+class keras::LayerSparseDense : public Layer {
+public:
+  LayerSparseDense() : Layer("SparseDense") {}
+
+  void load_weights(std::ifstream &fin);
+  keras::DataChunk* compute_output(keras::DataChunk*);
+  bool fold_batch_norm(std::vector<float> const & scale, std::vector<float> const & shift);
+  double get_flops(size_t in_size, size_t out_size) const;
+  size_t get_weights_bytes() const;
+  std::vector<int> m_row_ptr;    // input: weights of input j are [m_row_ptr[j], m_row_ptr[j+1])
+  std::vector<int> m_neuron_idx; // non-zero weight: neuron index
+  std::vector<float> m_values;   // non-zero weight: value
+  std::vector<float> m_bias;     // neuron
+
+  virtual unsigned int get_input_rows() const { return 1; } // flat, just one row
+  virtual unsigned int get_input_cols() const { return m_input_cnt; }
+  virtual unsigned int get_output_units() const { return m_neurons; }
+
+  int m_input_cnt;
+  int m_neurons;
+};
+
 class keras::KerasModel {
 public:
-  KerasModel(const std::string &input_fname);
+  // Serial: everything in the calling thread; IntraLayer: loops inside layers in parallel
+  // (default); Batch: samples of compute_output(vector) in parallel, each one serially
+  enum class Parallelism { Serial, IntraLayer, Batch };
+
+  // winograd_min_depth: use Winograd convolution for 3x3 kernels with at least this input
+  // depth, negative value switches it off;
+  // sparse_conv_layers: number of the first conv layers skipping empty regions of the image
+  KerasModel(const std::string &input_fname, int winograd_min_depth = 8, int sparse_conv_layers = 1);
   ~KerasModel();
   std::vector<float> compute_output(keras::DataChunk *dc);
+  std::vector< std::vector<float> > compute_output(std::vector<keras::DataChunk*> const & dcs);
+
+  // grain: minimum number of loop iterations (kernels, tiles or samples) per task;
+  // arena_threads > 0: run in a dedicated task arena with this number of threads
+  void set_parallelism(Parallelism p, size_t grain = 1, int arena_threads = 0);
+  Parallelism get_parallelism() const { return m_parallelism; }
+
+  // per-layer profiling, accumulated over all calls since set_profiling / reset_profile
+  struct LayerProfile {
+    std::string name;
+    double time_us = 0; // wall time
+    double flops = 0;   // estimated floating point operations
+    double bytes = 0;   // input, output and weights size
+    size_t calls = 0;
+  };
+  void set_profiling(bool on);
+  bool is_profiling() const { return m_profiling; }
+  void reset_profile();
+  std::vector<LayerProfile> get_profile() const;
+  void print_profile(std::ostream & os) const; // table with totals and values per call
 
   unsigned int get_input_rows() const { return m_layers.front()->get_input_rows(); }
   unsigned int get_input_cols() const { return m_layers.front()->get_input_cols(); }
@@ -225,8 +414,19 @@ private:
 
   void load_weights(const std::string &input_fname);
   int m_layers_cnt; // number of layers
+  int m_winograd_min_depth;
+  int m_sparse_conv_layers;
   std::vector<Layer *> m_layers; // container with layers
 
+  std::vector<float> compute_sample(keras::DataChunk *dc) const;
+  Parallelism m_parallelism = Parallelism::IntraLayer;
+  size_t m_grain = 1;
+  std::unique_ptr<tbb::task_arena> m_arena; // null: tbb default arena
+
+  bool m_profiling = false;
+  mutable std::vector<LayerProfile> m_profile; // updated in compute_output
+  mutable std::mutex m_profile_mutex;
+
 };
 
 #endif
@@ -0,0 +1,195 @@
+"""
+Generate C++ source of a model stored in the .nnet text format (see dump_to_simple_cpp.py),
+with all layer shapes known at compile time and weights as static arrays. Compile it into
+a plugin library loadable e.g. by the PointIdAlgAot tool:
+
+  python nnet_to_cpp.py -i model.nnet -o model.cc --rows 32 --cols 44
+  g++ -O3 -march=x86-64-v2 -std=c++17 -shared -fPIC -I$LARRECODNN_INC model.cc -o model.so
+
+Use the instruction set baseline of the nodes where the jobs run, not -march=native (illegal
+instruction on older worker nodes).
+
+The .nnet file does not store the input image size, so it has to be given (rows, cols and
+depth of the input image).
+"""
+from __future__ import print_function
+import argparse
+import os
+
+parser = argparse.ArgumentParser(description='Generate C++ plugin source from the .nnet model')
+
+parser.add_argument('-i', '--input', help="Model in the .nnet text format", required=True)
+parser.add_argument('-o', '--output', help="Output C++ file name", required=True)
+parser.add_argument('-r', '--rows', help="Rows of the input image", type=int, required=True)
+parser.add_argument('-c', '--cols', help="Columns of the input image", type=int, required=True)
+parser.add_argument('-d', '--depth', help="Depth of the input image", type=int, default=1)
+
+args = parser.parse_args()
+
+
+class Tokens(object):
+    def __init__(self, fname):
+        self.t = open(fname).read().replace('[', ' [ ').replace(']', ' ] ').split()
+        self.pos = 0
+
+    def next(self):
+        self.pos += 1
+        return self.t[self.pos - 1]
+
+    def floats(self, n):  # n numbers, brackets skipped
+        out = []
+        while len(out) < n:
+            s = self.next()
+            if s not in ('[', ']'):
+                out.append(float(s))
+        if self.pos < len(self.t) and self.t[self.pos] == ']':
+            self.pos += 1
+        return out
+
+
+def read_layers(fname):
+    tok = Tokens(fname)
+    tok.next()  # 'layers'
+    n = int(tok.next())
+    layers = []
+    for _ in range(n):
+        tok.next()  # 'layer'
+        tok.next()  # index
+        ltype = tok.next()
+        if ltype == 'Convolution2D':
+            k, d, r, c = [int(tok.next()) for _ in range(4)]
+            mode = tok.next()
+            if mode == '[':
+                mode = 'valid'
+            elif tok.t[tok.pos].isdigit() and (tok.next(), tok.next()) != ('1', '1'):
+                raise ValueError('Strided convolution not supported.')
+            w = tok.floats(k * d * r * c)
+            b = tok.floats(k)
+            layers.append(dict(type=ltype, k=k, d=d, r=r, c=c, mode=mode, w=w, b=b))
+        elif ltype == 'Activation':
+            layers.append(dict(type=ltype, act=tok.next()))
+        elif ltype == 'MaxPooling2D':
+            layers.append(dict(type=ltype, px=int(tok.next()), py=int(tok.next())))
+        elif ltype == 'Flatten':
+            layers.append(dict(type=ltype))
+        elif ltype == 'Dense':
+            nin, nout = int(tok.next()), int(tok.next())
+            w = tok.floats(nin * nout)
+            b = tok.floats(nout)
+            layers.append(dict(type=ltype, nin=nin, nout=nout, w=w, b=b))
+        elif ltype == 'SparseDense':
+            nin, nout, nnz = int(tok.next()), int(tok.next()), int(tok.next())
+            row_ptr = [int(v) for v in tok.floats(nin + 1)]
+            idx = [int(v) for v in tok.floats(nnz)]
+            val = tok.floats(nnz)
+            b = tok.floats(nout)
+            layers.append(dict(type=ltype, nin=nin, nout=nout, row_ptr=row_ptr, idx=idx, val=val, b=b))
+        elif ltype == 'Dropout':
+            continue
+        else:
+            raise ValueError('Layer type ' + ltype + ' not supported.')
+    return layers
+
+
+def flip(w, k, d, r, c):  # same as in KerasModel: rows and cols of each kernel reversed
+    out = []
+    for i in range(k * d):
+        kern = w[i * r * c:(i + 1) * r * c]
+        for a in range(r - 1, -1, -1):
+            out += list(reversed(kern[a * c:(a + 1) * c]))
+    return out
+
+
+def array(name, values, ctype='float', fmt='%.9gF'):
+    lines = []
+    for i in range(0, len(values), 8):
+        lines.append('    ' + ', '.join(fmt % v for v in values[i:i + 8]) + ',')
+    return ('  alignas(64) const %s %s[%d] = {\n' % (ctype, name, len(values)) +
+            '\n'.join(lines) + '\n  };\n')
+
+
+layers = read_layers(args.input)
+
+shape = (args.depth, args.rows, args.cols)  # current (depth, rows, cols), or (n,) if flat
+decls = []
+calls = []
+max_size = 0
+for i, l in enumerate(layers):
+    t = l['type']
+    if t == 'Convolution2D':
+        d, r, c = shape
+        if d != l['d']:
+            raise ValueError('Layer %d: input depth %d, kernel depth %d.' % (i, d, l['d']))
+        same = (l['mode'] != 'valid')
+        sx, sy = (l['r'] - 1) // 2, (l['c'] - 1) // 2
+        shape = (l['k'], r, c) if same else (l['k'], r - 2 * sx, c - 2 * sy)
+        decls.append('  typedef Conv2D<%d, %d, %d, %d, %d, %d, %s> L%d;\n' %
+                     (l['k'], d, r, c, l['r'], l['c'], 'true' if same else 'false', i))
+        decls.append(array('w%d' % i, flip(l['w'], l['k'], d, l['r'], l['c'])))
+        decls.append(array('b%d' % i, l['b']))
+        calls.append('L%d::compute(x, y, w%d, b%d); std::swap(x, y);' % (i, i, i))
+    elif t == 'Dense':
+        n = shape[0] * (shape[1] * shape[2] if len(shape) == 3 else 1)
+        if len(shape) != 1 or n != l['nin']:
+            raise ValueError('Layer %d: input size %d, dense layer inputs %d.' % (i, n, l['nin']))
+        shape = (l['nout'],)
+        decls.append('  typedef Dense<%d, %d> L%d;\n' % (l['nin'], l['nout'], i))
+        decls.append(array('w%d' % i, l['w']))
+        decls.append(array('b%d' % i, l['b']))
+        calls.append('L%d::compute(x, y, w%d, b%d); std::swap(x, y);' % (i, i, i))
+    elif t == 'SparseDense':
+        n = shape[0] * (shape[1] * shape[2] if len(shape) == 3 else 1)
+        if len(shape) != 1 or n != l['nin']:
+            raise ValueError('Layer %d: input size %d, dense layer inputs %d.' % (i, n, l['nin']))
+        shape = (l['nout'],)
+        decls.append('  typedef SparseDense<%d, %d> L%d;\n' % (l['nin'], l['nout'], i))
+        decls.append(array('rp%d' % i, l['row_ptr'], 'int', '%d'))
+        decls.append(array('idx%d' % i, l['idx'] or [0], 'int', '%d'))
+        decls.append(array('w%d' % i, l['val'] or [0]))
+        decls.append(array('b%d' % i, l['b']))
+        calls.append('L%d::compute(x, y, rp%d, idx%d, w%d, b%d); std::swap(x, y);' % (i, i, i, i, i))
+    elif t == 'MaxPooling2D':
+        d, r, c = shape
+        shape = (d, r // l['px'], c // l['py'])
+        decls.append('  typedef MaxPooling<%d, %d, %d, %d, %d> L%d;\n' % (d, r, c, l['px'], l['py'], i))
+        calls.append('L%d::compute(x, y); std::swap(x, y);' % i)
+    elif t == 'Flatten':
+        shape = (shape[0] * shape[1] * shape[2],)  # same memory layout, nothing to do
+    elif t == 'Activation':
+        n = shape[0] * (shape[1] * shape[2] if len(shape) == 3 else 1)
+        if l['act'] not in ('relu', 'tanh', 'sigmoid', 'softmax'):
+            raise ValueError('Activation ' + l['act'] + ' not supported.')
+        if l['act'] == 'softmax' and len(shape) != 1:
+            raise ValueError('Softmax of 3D data not supported.')
+        calls.append('%s<%d>(x);' % (l['act'], n))
+    n = shape[0] * (shape[1] * shape[2] if len(shape) == 3 else 1)
+    max_size = max(max_size, n)
+
+in_size = args.depth * args.rows * args.cols
+out_size = shape[0] * (shape[1] * shape[2] if len(shape) == 3 else 1)
+name = os.path.basename(args.input)
+
+with open(args.output, 'w') as fout:
+    fout.write('// Generated with nnet_to_cpp.py from %s, input %d x %d x %d. Do not edit.\n\n' %
+               (name, args.depth, args.rows, args.cols))
+    fout.write('#include "larrecodnn/ImagePatternAlgs/Keras/keras_aot.h"\n\n')
+    fout.write('#include <algorithm>\n#include <utility>\n\n')
+    fout.write('namespace {\n  using namespace keras::aot;\n\n')
+    fout.write('  constexpr int kInSize = %d, kOutSize = %d, kBufSize = %d;\n\n' %
+               (in_size, out_size, max(max_size, in_size)))
+    for s in decls:
+        fout.write(s)
+    fout.write('}\n\n')
+    fout.write('extern "C" const keras_aot_info * keras_aot_model_info(void)\n{\n')
+    fout.write('  static const keras_aot_info info = {"%s", %d, %d, %d, kOutSize};\n' %
+               (name, args.depth, args.rows, args.cols))
+    fout.write('  return &info;\n}\n\n')
+    fout.write('extern "C" void keras_aot_compute(const float * in, float * out)\n{\n')
+    fout.write('  alignas(64) static thread_local float buf_a[kBufSize], buf_b[kBufSize];\n')
+    fout.write('  float * x = buf_a;\n  float * y = buf_b;\n')
+    fout.write('  std::copy(in, in + kInSize, x);\n\n')
+    for s in calls:
+        fout.write('  ' + s + '\n')
+    fout.write('\n  std::copy(x, x + kOutSize, out);\n}\n')
+
+print('Written', args.output, 'with', len(layers), 'layers, output size', out_size)
@@ -0,0 +1,121 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Test:        keras_winograd_test
+//
+// Random two-layer 3x3 convolution models, odd and even image sizes and both border modes,
+// are computed with the Winograd F(2x2,3x3) path and with the direct convolution; outputs
+// have to agree within a relative tolerance.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "larrecodnn/ImagePatternAlgs/Keras/keras_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+  constexpr float kTolerance = 1.0e-4F; // relative to the largest output magnitude
+
+  void write_conv(std::ofstream & out, std::mt19937 & gen, int kernels, int depth,
+                  const std::string & border_mode)
+  {
+    std::uniform_real_distribution<float> w(-1.0F, 1.0F);
+    out << kernels << " " << depth << " 3 3 " << border_mode << "\n";
+    for (int k = 0; k < kernels; ++k) {
+      for (int d = 0; d < depth; ++d) {
+        for (int r = 0; r < 3; ++r) {
+          out << "[ " << w(gen) << " " << w(gen) << " " << w(gen) << "]\n";
+        }
+      }
+    }
+    out << "[";
+    for (int k = 0; k < kernels; ++k) { out << " " << 0.1F * w(gen); }
+    out << "]\n";
+  }
+
+  // conv (depth -> k1) + relu + conv (k1 -> k2) + flatten
+  void write_model(const std::string & fname, std::mt19937 & gen, int depth, int k1, int k2,
+                   const std::string & border_mode)
+  {
+    std::ofstream out(fname);
+    out.precision(9);
+    out << "layers 4\n";
+    out << "layer 0 Convolution2D\n";
+    write_conv(out, gen, k1, depth, border_mode);
+    out << "layer 1 Activation\nrelu\n";
+    out << "layer 2 Convolution2D\n";
+    write_conv(out, gen, k2, k1, border_mode);
+    out << "layer 3 Flatten\n";
+  }
+
+  std::vector<float> run(const std::string & fname, int winograd_min_depth,
+                         std::vector<std::vector<std::vector<float> > > const & input)
+  {
+    keras::KerasModel model(fname, winograd_min_depth, 0); // no sparse layers, only direct vs Winograd
+    keras::DataChunk2D sample;
+    sample.set_data(input);
+    return model.compute_output(&sample);
+  }
+
+}
+
+int main()
+{
+  std::mt19937 gen(12345);
+  std::uniform_real_distribution<float> adc(-1.0F, 1.0F);
+  const std::string fname = "keras_winograd_test.nnet";
+
+  const int sizes[][2] = { {8, 8}, {9, 7}, {16, 13}, {5, 6} };
+  const char* modes[] = { "valid", "same" };
+
+  int failures = 0;
+  double worst = 0;
+  for (int m = 0; m < 40; ++m) {
+    const int depth = 1 + m % 3;
+    const int k1 = 4 + m % 5, k2 = 2 + m % 3;
+    const auto & size = sizes[m % 4];
+    const std::string mode = modes[(m / 4) % 2];
+
+    write_model(fname, gen, depth, k1, k2, mode);
+
+    std::vector<std::vector<std::vector<float> > > input(
+      depth, std::vector<std::vector<float> >(size[0], std::vector<float>(size[1])));
+    for (auto & d : input) {
+      for (auto & r : d) {
+        for (auto & v : r) { v = adc(gen); }
+      }
+    }
+
+    auto const direct = run(fname, -1, input);
+    auto const winograd = run(fname, 0, input);
+    if (direct.empty() || (direct.size() != winograd.size())) {
+      std::cerr << "model " << m << ": output sizes " << direct.size() << " and "
+                << winograd.size() << std::endl;
+      ++failures;
+      continue;
+    }
+
+    float scale = 0, diff = 0;
+    for (size_t i = 0; i < direct.size(); ++i) {
+      scale = std::max(scale, std::fabs(direct[i]));
+      diff = std::max(diff, std::fabs(direct[i] - winograd[i]));
+    }
+    double rel = (scale > 0) ? diff / scale : diff;
+    worst = std::max(worst, rel);
+    if (rel > kTolerance) {
+      std::cerr << "model " << m << " (" << size[0] << "x" << size[1] << ", " << mode
+                << "): relative difference " << rel << std::endl;
+      ++failures;
+    }
+  }
+  std::remove(fname.c_str());
+
+  std::cout << "largest relative difference: " << worst << std::endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       Model
+//
+// Interface to run ONNX models with the CPU execution provider of ONNX Runtime.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "onnx_model.h"
+
+#include "onnxruntime_cxx_api.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+// Ort::IoBinding and Session::Run with a binding are available since ONNX Runtime 1.5
+#define ORT_HAS_IO_BINDING (ORT_API_VERSION >= 5)
+
+namespace
+{
+    Ort::Env & env() // one for all sessions in the process
+    {
+        static Ort::Env e(ORT_LOGGING_LEVEL_WARNING, "larrecodnn");
+        return e;
+    }
+
+    Ort::MemoryInfo & cpu()
+    {
+        static Ort::MemoryInfo m = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        return m;
+    }
+
+    std::string input_name(Ort::Session & s, size_t i, Ort::AllocatorWithDefaultOptions & a)
+    {
+#if ORT_API_VERSION >= 13
+        return s.GetInputNameAllocated(i, a).get();
+#else
+        char* name = s.GetInputName(i, a);
+        std::string result(name);
+        a.Free(name);
+        return result;
+#endif
+    }
+
+    std::string output_name(Ort::Session & s, size_t i, Ort::AllocatorWithDefaultOptions & a)
+    {
+#if ORT_API_VERSION >= 13
+        return s.GetOutputNameAllocated(i, a).get();
+#else
+        char* name = s.GetOutputName(i, a);
+        std::string result(name);
+        a.Free(name);
+        return result;
+#endif
+    }
+
+    GraphOptimizationLevel optimization_level(const std::string & name)
+    {
+        if (name == "disable") { return GraphOptimizationLevel::ORT_DISABLE_ALL; }
+        if (name == "basic") { return GraphOptimizationLevel::ORT_ENABLE_BASIC; }
+        if (name == "extended") { return GraphOptimizationLevel::ORT_ENABLE_EXTENDED; }
+        if (name == "all") { return GraphOptimizationLevel::ORT_ENABLE_ALL; }
+        throw std::invalid_argument("Graph optimization level " + name + " not supported.");
+    }
+
+    // dimensions except batch, product of them
+    std::vector<int64_t> sample_shape(const Ort::TypeInfo & info, size_t & size)
+    {
+        auto shape = info.GetTensorTypeAndShapeInfo().GetShape();
+        if (shape.empty()) { throw std::invalid_argument("Scalar inputs/outputs not supported."); }
+        shape.erase(shape.begin());
+        size = 1;
+        for (auto d : shape)
+        {
+            if (d < 1) { throw std::invalid_argument("Only the batch dimension can be dynamic."); }
+            size *= d;
+        }
+        return shape;
+    }
+}
+
+// -------------------------------------------------------------------
+std::unique_ptr<ort::Model> ort::Model::create(const char* model_file_name, const std::vector<std::string> & outputs,
+                                               const Options & options)
+{
+    try
+    {
+        return std::unique_ptr<Model>(new Model(model_file_name, outputs, options));
+    }
+    catch (const std::exception & e) // Ort::Exception as well
+    {
+        std::cout << e.what() << std::endl;
+        return nullptr;
+    }
+}
+// -------------------------------------------------------------------
+
+ort::Model::Model(const char* model_file_name, const std::vector<std::string> & outputs, const Options & options)
+    : fIoBinding(options.io_binding)
+{
+    Ort::SessionOptions session_options;
+    session_options.SetIntraOpNumThreads(options.intra_op_threads);
+    session_options.SetInterOpNumThreads(options.inter_op_threads);
+    session_options.SetGraphOptimizationLevel(optimization_level(options.optimization));
+    session_options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+
+    fSession = std::make_unique<Ort::Session>(env(), model_file_name, session_options);
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    fInputName = input_name(*fSession, 0, allocator);
+    fInputShape = sample_shape(fSession->GetInputTypeInfo(0), fInputSize);
+
+    for (size_t o = 0; o < fSession->GetOutputCount(); ++o)
+    {
+        std::string name = output_name(*fSession, o, allocator);
+        bool found = outputs.empty();
+        for (const auto & s : outputs)
+        {
+            if (name.find(s) != std::string::npos) { found = true; break; }
+        }
+        if (!found) { continue; }
+
+        size_t size;
+        fOutputShapes.push_back(sample_shape(fSession->GetOutputTypeInfo(o), size));
+        fOutputNames.push_back(name);
+        fOutputSizes.push_back(size);
+    }
+    if (fOutputNames.empty()) { throw std::invalid_argument("Output nodes not found in the model."); }
+    fOutputsSize = 0;
+    for (auto n : fOutputSizes) { fOutputsSize += n; }
+
+#if !ORT_HAS_IO_BINDING
+    if (fIoBinding)
+    {
+        std::cout << "IO binding not supported by this ONNX Runtime version, not used." << std::endl;
+        fIoBinding = false;
+    }
+#endif
+}
+
+ort::Model::~Model() = default;
+// -------------------------------------------------------------------
+
+std::vector< std::vector<float> > ort::Model::run(const std::vector<float> & x, size_t samples) const
+{
+    if ((samples == 0) || (x.size() < samples * fInputSize)) { return std::vector< std::vector<float> >(); }
+
+    std::vector< std::vector<float> > result(samples, std::vector<float>(fOutputsSize));
+
+    auto collect = [&](size_t o, size_t idx0, const float * out)
+    {
+        size_t n = fOutputSizes[o];
+        for (size_t s = 0; s < samples; ++s)
+        {
+            std::copy(out + s * n, out + (s + 1) * n, result[s].begin() + idx0);
+        }
+    };
+
+    std::vector<int64_t> shape(1, samples);
+    shape.insert(shape.end(), fInputShape.begin(), fInputShape.end());
+    auto input = Ort::Value::CreateTensor<float>(cpu(), const_cast<float*>(x.data()), samples * fInputSize,
+                                                 shape.data(), shape.size());
+
+#if ORT_HAS_IO_BINDING
+    if (fIoBinding)
+    {
+        // outputs of all models called on this thread go to one buffer, grown to the largest batch
+        thread_local std::vector<float> buffer;
+        if (buffer.size() < samples * fOutputsSize) { buffer.resize(samples * fOutputsSize); }
+
+        Ort::IoBinding binding(*fSession);
+        binding.BindInput(fInputName.c_str(), input); // the caller's memory, no copy
+
+        std::vector<Ort::Value> outputs; // kept alive until the run is done
+        outputs.reserve(fOutputNames.size());
+        float* out = buffer.data();
+        for (size_t o = 0; o < fOutputNames.size(); ++o)
+        {
+            shape.resize(1);
+            shape.insert(shape.end(), fOutputShapes[o].begin(), fOutputShapes[o].end());
+            outputs.push_back(Ort::Value::CreateTensor<float>(cpu(), out, samples * fOutputSizes[o],
+                                                              shape.data(), shape.size()));
+            binding.BindOutput(fOutputNames[o].c_str(), outputs.back());
+            out += samples * fOutputSizes[o];
+        }
+        fSession->Run(Ort::RunOptions{nullptr}, binding);
+
+        size_t idx0 = 0;
+        out = buffer.data();
+        for (size_t o = 0; o < fOutputNames.size(); ++o)
+        {
+            collect(o, idx0, out);
+            idx0 += fOutputSizes[o];
+            out += samples * fOutputSizes[o];
+        }
+    }
+    else
+#endif
+    {
+        const char* in_name = fInputName.c_str();
+        std::vector<const char*> out_names;
+        for (const auto & n : fOutputNames) { out_names.push_back(n.c_str()); }
+
+        auto outputs = fSession->Run(Ort::RunOptions{nullptr}, &in_name, &input, 1, out_names.data(), out_names.size());
+
+        size_t idx0 = 0;
+        for (size_t o = 0; o < outputs.size(); ++o)
+        {
+            collect(o, idx0, outputs[o].GetTensorData<float>());
+            idx0 += fOutputSizes[o];
+        }
+    }
+    return result;
+}
+// -------------------------------------------------------------------
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//// Class:       Model
+////
+//// Interface to run ONNX models with the CPU execution provider of ONNX Runtime, counterpart
+//// of tf::Graph. The model input is the first input of the graph, with the batch as its first,
+//// dynamic dimension and all the other dimensions fixed; outputs are the graph outputs with
+//// names containing provided strings (all outputs if none provided), concatenated per sample.
+////
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef OnnxModel_h
+#define OnnxModel_h
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Ort
+{
+    struct Session;
+}
+
+namespace ort
+{
+
+/// Session settings, by default single thread so it doesn't eat batch farms.
+struct ModelOptions
+{
+    int intra_op_threads = 1;
+    int inter_op_threads = 1;
+    std::string optimization = "all"; // graph optimizations: disable, basic, extended or all
+    bool io_binding = false;          // input bound in place, outputs written to per-thread
+                                      // buffers reused between calls; ONNX Runtime 1.5 or newer
+};
+
+class Model
+{
+public:
+    typedef ModelOptions Options;
+
+    /// Returns nullptr if the model can not be loaded.
+    static std::unique_ptr<Model> create(const char* model_file_name, const std::vector<std::string> & outputs = {},
+                                         const Options & options = Options());
+
+    ~Model();
+
+    /// Size of one input sample (product of the input dimensions except batch).
+    size_t input_size() const { return fInputSize; }
+    const std::vector<int64_t> & input_shape() const { return fInputShape; } // without batch
+
+    /// x: samples, each of input_size() values in the row-major order of the input shape;
+    /// can be called concurrently
+    std::vector< std::vector<float> > run(const std::vector<float> & x, size_t samples) const;
+
+private:
+    Model(const char* model_file_name, const std::vector<std::string> & outputs, const Options & options);
+
+    std::unique_ptr<Ort::Session> fSession;
+    bool fIoBinding;
+
+    std::string fInputName;
+    std::vector<int64_t> fInputShape;
+    size_t fInputSize;
+    std::vector<std::string> fOutputNames;
+    std::vector< std::vector<int64_t> > fOutputShapes; // without batch
+    std::vector<size_t> fOutputSizes;
+    size_t fOutputsSize; // sum of fOutputSizes
+};
+
+} // namespace ort
+
+#endif
@@ -4,9 +4,9 @@
 #include "art/Framework/Principal/Event.h"
 #include "art/Framework/Principal/Handle.h"
 #include "art/Framework/Services/System/TriggerNamesService.h"
-#include "art/Utilities/make_tool.h"
 #include "canvas/Utilities/InputTag.h"
 #include "cetlib/container_algorithms.h"
+#include "fhiclcpp/ParameterSet.h"
 #include "fhiclcpp/types/Atom.h"
 #include "fhiclcpp/types/Sequence.h"
 #include "fhiclcpp/types/Table.h"
@@ -20,8 +20,18 @@
 #include "lardataobj/RecoBase/Cluster.h"
 #include "lardataobj/RecoBase/Hit.h"
 #include "lardataobj/RecoBase/Track.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/BatchSizeTuner.h"
 #include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/MakePointIdAlgTool.h"
 
+#include "tbb/parallel_for.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
 #include <memory>
 #include <unordered_map>
 #include <vector>
@@ -43,6 +53,22 @@ namespace nnet {
         Name("BatchSize"),
         Comment("number of samples processed in one batch")};
 
+      fhicl::Sequence<size_t> BatchSizeCandidates{
+        Name("BatchSizeCandidates"),
+        Comment("if not empty, throughput of these batch sizes is measured on the "
+                "first events and the fastest one is used"),
+        std::vector<size_t>()};
+
+      fhicl::Atom<size_t> BatchSizeTuningSamples{
+        Name("BatchSizeTuningSamples"),
+        Comment("number of hits measured for each batch size candidate"),
+        4096};
+
+      fhicl::Atom<float> BatchSizeHysteresis{
+        Name("BatchSizeHysteresis"),
+        Comment("BatchSize is replaced only by candidates faster by this fraction"),
+        0.05F};
+
       fhicl::Atom<art::InputTag> WireLabel{
         Name("WireLabel"),
         Comment("tag of deconvoluted ADC on wires (recob::Wire)")};
@@ -65,18 +91,181 @@ namespace nnet {
       fhicl::Sequence<int> Views{Name("Views"),
                                  Comment("tag clusters in selected views only, "
                                          "or in all views if empty list")};
+
+      fhicl::Atom<std::string> HitSelection{
+        Name("HitSelection"),
+        Comment("hits passed to the CNN: \"all\" hits of the selected views, "
+                "or only hits of the input \"clusters\", \"tracks\" or "
+                "\"clustersAndTracks\"; outputs of not evaluated hits are set "
+                "to -1 and such hits are not used in accumulated results"),
+        "all"};
+
+      fhicl::Atom<float> ClusterScoreTolerance{
+        Name("ClusterScoreTolerance"),
+        Comment("if > 0, hits of each input cluster are scored in batches, in "
+                "a fixed order spread over the cluster, until the confidence "
+                "interval half-width of the cluster score (geometric mean of "
+                "hit outputs, as written for the output clusters) is below "
+                "this value; remaining cluster hits are not evaluated"),
+        0.0F};
+
+      fhicl::Atom<float> ClusterScoreZ{
+        Name("ClusterScoreZ"),
+        Comment("confidence interval width in standard errors of the mean"),
+        2.0F};
+
+      fhicl::Atom<size_t> ClusterScoreMinHits{
+        Name("ClusterScoreMinHits"),
+        Comment("min. number of scored hits in fid. area before stopping"),
+        16};
+
+      fhicl::Atom<size_t> ClusterScoreMaxHits{
+        Name("ClusterScoreMaxHits"),
+        Comment("max. number of scored hits per cluster, no limit if 0"),
+        0};
+
+      fhicl::Atom<size_t> ClusterScoreBatchSize{
+        Name("ClusterScoreBatchSize"),
+        Comment("number of cluster hits scored between convergence checks"),
+        32};
+
+      fhicl::Sequence<std::string> ModelInstances{
+        Name("ModelInstances"),
+        Comment("with several models in PointIdAlg (PointIdAlgMulti): product "
+                "instance names of hit outputs of the 2nd, 3rd, ... model; the "
+                "first model, N outputs, is used for all other products"),
+        std::vector<std::string>()};
     };
     explicit EmTrack(Config const& c,
                      std::string const& s,
-                     art::ProducesCollector& pc);
+                     art::ProducesCollector& pc,
+                     std::string const& instance = "emtrkmichel");
     void produce(art::Event& e);
 
+    /// output value stored for hits not passed to the CNN
+    static constexpr float kNotEvaluated = -1.0F;
+
   private:
+    /// hit outputs of an additional model of a multi-model PointIdAlg tool
+    struct ModelOutput {
+      virtual ~ModelOutput() = default;
+      virtual size_t size() const = 0;
+      virtual void init(art::InputTag const& tag, size_t nhits) = 0;
+      virtual void set(size_t key, std::vector<float>::const_iterator values) = 0;
+      virtual void save(art::Event& evt) = 0;
+    };
+
+    template <size_t M>
+    struct ModelOutputN : public ModelOutput {
+      ModelOutputN(art::ProducesCollector& pc,
+                   std::string const& instance,
+                   std::vector<std::string> const& labels)
+        : writer(pc, instance), labels(labels)
+      {
+        writer.template produces_using<recob::Hit>();
+      }
+      size_t
+      size() const override
+      {
+        return M;
+      }
+      void
+      init(art::InputTag const& tag, size_t nhits) override
+      {
+        id = writer.template initOutputs<recob::Hit>(tag, nhits, labels);
+      }
+      void
+      set(size_t key, std::vector<float>::const_iterator values) override
+      {
+        std::array<float, M> v;
+        std::copy_n(values, M, v.begin());
+        writer.template setOutput(id, key, v);
+      }
+      void
+      save(art::Event& evt) override
+      {
+        writer.template saveOutputs(evt);
+      }
+
+      anab::MVAWriter<M> writer;
+      std::vector<std::string> const labels;
+      anab::FVector_ID id;
+    };
+
+    template <size_t M = 1>
+    static std::unique_ptr<ModelOutput> makeModelOutput(
+      size_t size,
+      art::ProducesCollector& pc,
+      std::string const& instance,
+      std::vector<std::string> const& labels);
+
+    /// running mean and variance of the log-clamped CNN outputs of sampled
+    /// cluster hits, the statistic accumulated by MVAWriter::getOutput for
+    /// the cluster score (weighted geometric mean, normalized to sum to 1)
+    struct RunningScore {
+      size_t n = 0;
+      std::array<double, N> mean{};
+      std::array<double, N> m2{};
+
+      template <class V>
+      void
+      add(V const& v)
+      {
+        double const pmin = 1.0e-6, pmax = 1.0 - pmin;
+        ++n;
+        for (size_t i = 0; i < N; ++i) {
+          double x = std::log(std::clamp<double>(v[i], pmin, pmax));
+          double d = x - mean[i];
+          mean[i] += d / n;
+          m2[i] += d * (x - mean[i]);
+        }
+      }
+
+      /// max. over outputs of the confidence interval half-width of the
+      /// cluster score, z standard errors of the mean log-outputs (with finite
+      /// population correction for clusters of size pop) propagated to the
+      /// normalized score to first order
+      double
+      halfWidth(double z, size_t pop) const
+      {
+        if (n >= pop)
+          return 0;
+        if (n < 2)
+          return std::numeric_limits<double>::max();
+
+        double const fpc = double(pop - n) / (pop - 1);
+        std::array<double, N> hw, p;
+        double totp = 0;
+        for (size_t i = 0; i < N; ++i) {
+          hw[i] = z * std::sqrt(m2[i] / (n - 1) / n * fpc);
+          p[i] = std::exp(mean[i]);
+          totp += p[i];
+        }
+        for (size_t i = 0; i < N; ++i) {
+          p[i] /= totp;
+        }
+
+        // d p_i / d mean_j = p_i (delta_ij - p_j)
+        double w = 0;
+        for (size_t i = 0; i < N; ++i) {
+          double wi = p[i] * (1 - p[i]) * hw[i];
+          for (size_t j = 0; j < N; ++j) {
+            if (j != i)
+              wi += p[i] * p[j] * hw[j];
+          }
+          w = std::max(w, wi);
+        }
+        return w;
+      }
+    };
+
     bool isViewSelected(int view) const;
-    const size_t fBatchSize;
+    BatchSizeTuner fBatchSize;
     std::unique_ptr<PointIdAlgTools::IPointIdAlg> fPointIdAlgTool;
+    std::vector<std::string> fOutputLabels; // labels of the first N outputs
     using writer = anab::MVAWriter<N>;
     writer fMVAWriter;
+    std::vector<std::unique_ptr<ModelOutput>> fModelOutputs;
     const art::InputTag fWireProducerLabel;
     const art::InputTag fHitModuleLabel;
     const art::InputTag fClusterModuleLabel;
@@ -84,19 +273,39 @@ namespace nnet {
     const bool fDoClusters;
     const bool fDoTracks;
     const std::vector<int> fViews;
+    bool fHitsInClusters;
+    bool fHitsInTracks;
+    const float fClusterScoreTolerance;
+    const float fClusterScoreZ;
+    const size_t fClusterScoreMinHits;
+    const size_t fClusterScoreMaxHits;
+    const size_t fClusterScoreBatchSize;
     const art::InputTag
       fNewClustersTag; // input tag for the clusters produced by this module
     void make_clusters(art::Event& evt,
                        std::vector<art::Ptr<recob::Hit>> const& hitPtrList,
                        std::vector<char> const& hitInFA,
                        EmTrack::cryo_tpc_view_keymap const& hitMap);
-    void make_tracks(art::Event const& evt, std::vector<char> const& hitInFA);
+    void make_tracks(art::Event const& evt,
+                     std::vector<art::Ptr<recob::Hit>> const& hitPtrList,
+                     std::vector<char> const& hitInFA);
     cryo_tpc_view_keymap create_hitmap(
       std::vector<art::Ptr<recob::Hit>> const& hitPtrList) const;
+    std::vector<char> select_hits(art::Event const& evt,
+                                  size_t nhits) const;
+    std::map<key, std::vector<std::vector<size_t>>> create_cluster_hitmap(
+      art::Event const& evt) const;
+    static std::vector<size_t> sampling_order(
+      std::vector<size_t> const& cluHits,
+      std::vector<art::Ptr<recob::Hit>> const& hitPtrList);
+    void setOutputs(anab::FVector_ID hitID,
+                    size_t key,
+                    std::vector<float> const& values);
     std::vector<char> classify_hits(
       art::Event const& evt,
       EmTrack::cryo_tpc_view_keymap const& hitMap,
-      std::vector<art::Ptr<recob::Hit>> const& hitPtrList);
+      std::vector<art::Ptr<recob::Hit>> const& hitPtrList,
+      std::vector<char> const& hitSelected);
   };
 
   template <size_t N>
@@ -129,7 +338,7 @@ namespace nnet {
     }
 
     auto cluID = fMVAWriter.template initOutputs<recob::Cluster>(
-      fNewClustersTag, fPointIdAlgTool->outputLabels());
+      fNewClustersTag, fOutputLabels);
 
     unsigned int cidx = 0; // new clusters index
     art::FindManyP<recob::Hit> hitsFromClusters(
@@ -256,56 +465,119 @@ namespace nnet {
     evt.put(std::move(clu2hit));
   }
 
-  /// make tracks
+  /// make tracks: outputs accumulated over hits in the best plane of each
+  /// track, the plane with max. number of hits where collection planes count
+  /// twice (ties resolved to the higher plane index)
   template <size_t N>
   void
   EmTrack<N>::make_tracks(art::Event const& evt,
+                          std::vector<art::Ptr<recob::Hit>> const& hitPtrList,
                           std::vector<char> const& hitInFA)
   {
     auto trkListHandle =
       evt.getValidHandle<std::vector<recob::Track>>(fTrackModuleLabel);
-    art::FindManyP<recob::Hit> hitsFromTracks(
-      trkListHandle, evt, fTrackModuleLabel);
-    std::vector<std::vector<art::Ptr<recob::Hit>>> trkHitPtrList(
-      trkListHandle->size());
-    for (size_t t = 0; t < trkListHandle->size(); ++t) {
-      auto v = hitsFromTracks.at(t);
-      size_t nh[3] = {0, 0, 0};
-      for (auto const& hptr : v) {
-        ++nh[hptr->View()];
+    auto trkHitAssns =
+      evt.getValidHandle<art::Assns<recob::Track, recob::Hit>>(
+        fTrackModuleLabel);
+    size_t const nTracks = trkListHandle->size();
+
+    art::ServiceHandle<geo::Geometry const> geom;
+    size_t const nPlanes = geom->MaxPlanes();
+    std::map<geo::PlaneID, unsigned int> planeWeight; // signal type of each hit plane
+    auto weightOf = [&](geo::PlaneID const& plane) {
+      auto it = planeWeight.find(plane);
+      if (it == planeWeight.end()) {
+        unsigned int w = (geom->SignalType(plane) == geo::kCollection) ? 2 : 1;
+        it = planeWeight.emplace(plane, w).first;
+      }
+      return it->second;
+    };
+
+    // hit keys and planes of each track, flat with offsets per track
+    std::vector<size_t> offsets(nTracks + 1, 0);
+    for (auto const& [trk, hit] : *trkHitAssns) {
+      ++offsets[trk.key() + 1];
+    }
+    for (size_t t = 0; t < nTracks; ++t) {
+      offsets[t + 1] += offsets[t];
+    }
+    std::vector<size_t> hitKeys(offsets.back());
+    std::vector<unsigned int> hitPlanes(offsets.back());
+    std::vector<unsigned int> hitWeights(offsets.back()); // collection plane hits count twice
+    {
+      std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+      for (auto const& [trk, hit] : *trkHitAssns) {
+        size_t i = pos[trk.key()]++;
+        auto const& wid = hitPtrList[hit.key()]->WireID();
+        hitKeys[i] = hit.key();
+        hitPlanes[i] = wid.Plane;
+        hitWeights[i] = weightOf(wid.planeID());
+      }
+    }
+
+    auto trkID = fMVAWriter.template initOutputs<recob::Track>(
+      fTrackModuleLabel, nTracks, fOutputLabels);
+
+    auto scoreTrack = [&](size_t t) { // t is the Ptr< recob::Track >::key()
+      std::vector<size_t> nh(nPlanes, 0); // weighted number of hits
+      for (size_t i = offsets[t]; i < offsets[t + 1]; ++i) {
+        if (hitPlanes[i] < nPlanes)
+          nh[hitPlanes[i]] += hitWeights[i];
+      }
+      size_t best_plane = nPlanes - 1;
+      for (size_t p = 0; p < nPlanes; ++p) {
+        if (nh[p] >= nh[best_plane])
+          best_plane = p;
       }
-      size_t best_view = 2; // collection
-      if ((nh[0] >= nh[1]) && (nh[0] > 2 * nh[2]))
-        best_view = 0; // ind1
-      if ((nh[1] >= nh[0]) && (nh[1] > 2 * nh[2]))
-        best_view = 1; // ind2
 
       size_t k = 0;
-      while (!isViewSelected(best_view)) {
-        best_view = (best_view + 1) % 3;
-        if (++k > 3) {
+      while (!isViewSelected(best_plane)) {
+        best_plane = (best_plane + 1) % nPlanes;
+        if (++k > nPlanes) {
           throw cet::exception("EmTrack")
             << "No views selected at all?" << std::endl;
         }
       }
 
-      for (auto const& hptr : v) {
-        if (hptr->View() == best_view)
-          trkHitPtrList[t].emplace_back(hptr);
+      // weighted geometric mean of hit outputs, as in MVAWriter::getOutput
+      std::array<double, N> acc;
+      acc.fill(0);
+      double const pmin = 1.0e-6, pmax = 1.0 - pmin;
+      double const log_pmin = std::log(pmin), log_pmax = std::log(pmax);
+      double totw = 0;
+      for (size_t i = offsets[t]; i < offsets[t + 1]; ++i) {
+        float const w = hitInFA[hitKeys[i]];
+        if ((hitPlanes[i] != best_plane) || (w == 0))
+          continue;
+
+        auto const vout = fMVAWriter.template getOutput<recob::Hit>(hitKeys[i]);
+        for (size_t o = 0; o < N; ++o) {
+          double v = (vout[o] < pmin) ? log_pmin :
+                     (vout[o] > pmax) ? log_pmax :
+                                        std::log(vout[o]);
+          acc[o] += w * v;
+        }
+        totw += w;
       }
-    }
 
-    auto trkID = fMVAWriter.template initOutputs<recob::Track>(
-      fTrackModuleLabel, trkHitPtrList.size(), fPointIdAlgTool->outputLabels());
-    for (size_t t = 0; t < trkHitPtrList.size();
-         ++t) // t is the Ptr< recob::Track >::key()
-    {
-      auto vout = fMVAWriter.template getOutput<recob::Hit>(
-        trkHitPtrList[t], [&](art::Ptr<recob::Hit> const& ptr) {
-          return (float)hitInFA[ptr.key()];
-        });
-      fMVAWriter.template setOutput(trkID, t, vout);
-    }
+      std::array<float, N> result;
+      if (totw > 0) {
+        double totp = 0;
+        for (size_t o = 0; o < N; ++o) {
+          acc[o] = std::exp(acc[o] / totw);
+          totp += acc[o];
+        }
+        for (size_t o = 0; o < N; ++o) {
+          result[o] = acc[o] / totp;
+        }
+      }
+      else {
+        result.fill(1.0F / N);
+      }
+      fMVAWriter.template setOutput(trkID, t, result);
+    };
+
+    tbb::parallel_for(size_t(0), nTracks, scoreTrack);
   }
   template <size_t N>
   typename EmTrack<N>::cryo_tpc_view_keymap
@@ -327,14 +599,84 @@ namespace nnet {
     return hitMap;
   }
 
+  /// tag hits to be passed to the CNN, empty vector if all hits are selected
+  template <size_t N>
+  std::vector<char>
+  EmTrack<N>::select_hits(art::Event const& evt, size_t nhits) const
+  {
+    std::vector<char> hitSelected;
+    if (!fHitsInClusters && !fHitsInTracks)
+      return hitSelected;
+
+    hitSelected.resize(nhits, 0);
+    auto tagHits = [&](art::InputTag const& tag, auto const& handle) {
+      art::FindManyP<recob::Hit> hitsFromObjects(handle, evt, tag);
+      for (size_t i = 0; i < handle->size(); ++i) {
+        for (auto const& hptr : hitsFromObjects.at(i)) {
+          hitSelected[hptr.key()] = 1;
+        }
+      }
+    };
+    if (fHitsInClusters) {
+      tagHits(fClusterModuleLabel,
+              evt.getValidHandle<std::vector<recob::Cluster>>(
+                fClusterModuleLabel));
+    }
+    if (fHitsInTracks) {
+      tagHits(
+        fTrackModuleLabel,
+        evt.getValidHandle<std::vector<recob::Track>>(fTrackModuleLabel));
+    }
+    return hitSelected;
+  }
+
+  /// split outputs of the models among the hit output products
+  template <size_t N>
+  void
+  EmTrack<N>::setOutputs(anab::FVector_ID hitID,
+                         size_t key,
+                         std::vector<float> const& values)
+  {
+    std::array<float, N> first;
+    std::copy_n(values.begin(), N, first.begin());
+    fMVAWriter.template setOutput(hitID, key, first);
+
+    auto it = values.begin() + N;
+    for (auto& mo : fModelOutputs) {
+      mo->set(key, it);
+      it += mo->size();
+    }
+  }
+
+  template <size_t N>
+  template <size_t M>
+  std::unique_ptr<typename EmTrack<N>::ModelOutput>
+  EmTrack<N>::makeModelOutput(size_t size,
+                              art::ProducesCollector& pc,
+                              std::string const& instance,
+                              std::vector<std::string> const& labels)
+  {
+    if constexpr (M > 8) {
+      throw cet::exception("EmTrack")
+        << "models with more than 8 outputs not supported." << std::endl;
+    }
+    else {
+      if (size == M) {
+        return std::make_unique<ModelOutputN<M>>(pc, instance, labels);
+      }
+      return makeModelOutput<M + 1>(size, pc, instance, labels);
+    }
+  }
+
   template <size_t N>
   std::vector<char>
   EmTrack<N>::classify_hits(art::Event const& evt,
                             EmTrack::cryo_tpc_view_keymap const& hitMap,
-                            std::vector<art::Ptr<recob::Hit>> const& hitPtrList)
+                            std::vector<art::Ptr<recob::Hit>> const& hitPtrList,
+                            std::vector<char> const& hitSelected)
   {
     auto hitID = fMVAWriter.template initOutputs<recob::Hit>(
-      fHitModuleLabel, hitPtrList.size(), fPointIdAlgTool->outputLabels());
+      fHitModuleLabel, hitPtrList.size(), fOutputLabels);
 
     auto const clockData =
       art::ServiceHandle<detinfo::DetectorClocksService const>()->DataFor(evt);
@@ -346,58 +688,251 @@ namespace nnet {
     std::vector<char> hitInFA(hitPtrList.size(),
                               0); // tag hits in fid. area as 1, use 0 for hits
                                   // close to the projectrion edges
-    for (auto const& [key, hits] : hitMap) {
+    std::vector<float> notEvaluated(
+      std::max(N, fPointIdAlgTool->outputLabels().size()), kNotEvaluated);
+    for (auto& mo : fModelOutputs) {
+      mo->init(fHitModuleLabel, hitPtrList.size());
+    }
+    size_t nEvaluated = 0, nSkipped = 0;
+
+    // hits of input clusters, scored only until the cluster mean is stable
+    const bool sampling = (fClusterScoreTolerance > 0);
+    std::map<key, std::vector<std::vector<size_t>>> cluHitMap;
+    std::vector<char> hitInCluster, hitDone;
+    if (sampling) {
+      cluHitMap = create_cluster_hitmap(evt);
+      hitInCluster.resize(hitPtrList.size(), 0);
+      for (auto const& [key, clusters_hits] : cluHitMap) {
+        for (auto const& v : clusters_hits) {
+          for (size_t h : v) {
+            hitInCluster[h] = 1;
+          }
+        }
+      }
+      hitDone.resize(hitPtrList.size(), 0);
+    }
+
+    // score hits keys[begin, end) in one batch
+    auto classify = [&](std::vector<size_t> const& keys,
+                        size_t begin,
+                        size_t end) {
+      std::vector<std::pair<unsigned int, float>> points;
+      for (size_t i = begin; i < end; ++i) {
+        const recob::Hit& hit = *(hitPtrList[keys[i]]);
+        points.emplace_back(hit.WireID().Wire, hit.PeakTime());
+      }
+
+      std::vector<char> inside;
+      auto batch_out = fPointIdAlgTool->predictIdVectors(points, inside);
+      if (points.size() != batch_out.size()) {
+        throw cet::exception("EmTrack")
+          << "hits processing failed" << std::endl;
+      }
+
+      for (size_t k = 0; k < points.size(); ++k) {
+        size_t h = keys[begin + k]; // h is the Ptr< recob::Hit >::key()
+        if (fModelOutputs.empty()) {
+          fMVAWriter.template setOutput(hitID, h, batch_out[k]);
+        }
+        else {
+          setOutputs(hitID, h, batch_out[k]);
+        }
+        hitInFA[h] = inside[k];
+        if (sampling) { hitDone[h] = 1; }
+      }
+      nEvaluated += points.size();
+      return batch_out;
+    };
+
+    std::vector<size_t> selected;
+    for (auto const& [key, planeHits] : hitMap) {
       auto const& [cryo, tpc, view] = key;
       if (!isViewSelected(view))
         continue; // should not happen, hits were selected
 
+      auto const* hitsPtr = &planeHits;
+      if (!hitSelected.empty() || sampling) {
+        selected.clear();
+        for (size_t h : planeHits) {
+          if (sampling && hitInCluster[h])
+            continue; // done with clusters below
+
+          if (hitSelected.empty() || hitSelected[h]) { selected.push_back(h); }
+          else {
+            setOutputs(hitID, h, notEvaluated);
+            ++nSkipped;
+          }
+        }
+        hitsPtr = &selected;
+      }
+      auto const& hits = *hitsPtr;
+
+      auto const cluIt = cluHitMap.find(key);
+      if (hits.empty() && (cluIt == cluHitMap.end()))
+        continue;
+
       fPointIdAlgTool->setWireDriftData(
         clockData, detProp, *wireHandle, view, tpc, cryo);
 
-      // (1) do all hits in this plane
+      // (0) sample hits of clusters in this plane
       // ------------------------------------------------
-      for (size_t idx = 0; idx < hits.size(); idx += fBatchSize) {
-        std::vector<std::pair<unsigned int, float>> points;
-        std::vector<size_t> keys;
-        for (size_t k = 0; k < fBatchSize; ++k) {
-          if (idx + k >= hits.size()) {
-            break;
-          } // careful about the tail
-
-          size_t h = hits[idx + k]; // h is the Ptr< recob::Hit >::key()
-          const recob::Hit& hit = *(hitPtrList[h]);
-          points.emplace_back(hit.WireID().Wire, hit.PeakTime());
-          keys.push_back(h);
-        }
+      if (cluIt != cluHitMap.end()) {
+        for (auto const& cluHits : cluIt->second) {
+          auto const order = sampling_order(cluHits, hitPtrList);
+          size_t const limit =
+            fClusterScoreMaxHits ?
+              std::min(fClusterScoreMaxHits, order.size()) :
+              order.size();
 
-        auto batch_out = fPointIdAlgTool->predictIdVectors(points);
-        if (points.size() != batch_out.size()) {
-          throw cet::exception("EmTrack")
-            << "hits processing failed" << std::endl;
-        }
+          RunningScore score;
+          std::vector<size_t> todo;
+          size_t done = 0;
+          while (done < limit) {
+            // hits scored already through another cluster are not redone
+            todo.clear();
+            size_t end = done;
+            for (; (end < limit) && (todo.size() < fClusterScoreBatchSize);
+                 ++end) {
+              size_t const h = order[end];
+              if (!hitDone[h]) { todo.push_back(h); }
+              else if (hitInFA[h]) {
+                score.add(fMVAWriter.template getOutput<recob::Hit>(h));
+              }
+            }
+            if (!todo.empty()) {
+              auto const batch_out = classify(todo, 0, todo.size());
+              for (size_t k = 0; k < batch_out.size(); ++k) {
+                if (hitInFA[todo[k]]) { score.add(batch_out[k]); }
+              }
+            }
+            done = end;
 
-        for (size_t k = 0; k < points.size(); ++k) {
-          size_t h = keys[k];
-          fMVAWriter.template setOutput(hitID, h, batch_out[k]);
-          if (fPointIdAlgTool->isInsideFiducialRegion(points[k].first,
-                                                      points[k].second)) {
-            hitInFA[h] = 1;
+            if ((score.n >= fClusterScoreMinHits) &&
+                (score.halfWidth(fClusterScoreZ, order.size()) <
+                 fClusterScoreTolerance)) {
+              break;
+            }
           }
         }
+      }
+
+      // (1) do all (remaining) hits in this plane
+      // ------------------------------------------------
+      for (size_t idx = 0; idx < hits.size();) {
+        size_t const batch = fBatchSize.batchSize();
+        size_t const end = std::min(idx + batch, hits.size());
+        auto const t0 = std::chrono::steady_clock::now();
+        classify(hits, idx, end);
+        fBatchSize.record(
+          batch,
+          end - idx,
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+            .count());
+        idx = end;
       } // hits done
         // ------------------------------------------------------------------
+
+      if (cluIt != cluHitMap.end()) {
+        for (auto const& cluHits : cluIt->second) {
+          for (size_t h : cluHits) {
+            if (!hitDone[h]) {
+              setOutputs(hitID, h, notEvaluated);
+              hitDone[h] = 1; // also if shared by clusters
+              ++nSkipped;
+            }
+          }
+        }
+      }
+    }
+    if (nSkipped) {
+      mf::LogVerbatim("EmTrack") << "hits evaluated: " << nEvaluated
+                                 << ", not evaluated: " << nSkipped;
     }
     return hitInFA;
   }
+
+  /// hit keys of input clusters, in the same cryo/tpc/view order as hits
+  template <size_t N>
+  std::map<typename EmTrack<N>::key, std::vector<std::vector<size_t>>>
+  EmTrack<N>::create_cluster_hitmap(art::Event const& evt) const
+  {
+    std::map<key, std::vector<std::vector<size_t>>> cluHitMap;
+
+    auto cluListHandle =
+      evt.getValidHandle<std::vector<recob::Cluster>>(fClusterModuleLabel);
+    art::FindManyP<recob::Hit> hitsFromClusters(
+      cluListHandle, evt, fClusterModuleLabel);
+    for (size_t c = 0; c < cluListHandle->size(); ++c) {
+      auto const& plane = (*cluListHandle)[c].Plane();
+      if (!isViewSelected(plane.Plane))
+        continue;
+
+      auto const v = hitsFromClusters.at(c);
+      if (v.empty())
+        continue;
+
+      std::vector<size_t> keys;
+      keys.reserve(v.size());
+      for (auto const& hptr : v) {
+        keys.push_back(hptr.key());
+      }
+      cluHitMap[{plane.Cryostat, plane.TPC, plane.Plane}].push_back(
+        std::move(keys));
+    }
+    return cluHitMap;
+  }
+
+  /// cluster hits sorted along wires/drift and reordered so that any leading
+  /// subset is spread evenly over the cluster (van der Corput sequence)
+  template <size_t N>
+  std::vector<size_t>
+  EmTrack<N>::sampling_order(
+    std::vector<size_t> const& cluHits,
+    std::vector<art::Ptr<recob::Hit>> const& hitPtrList)
+  {
+    std::vector<size_t> sorted(cluHits);
+    std::sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) {
+      auto const& ha = *hitPtrList[a];
+      auto const& hb = *hitPtrList[b];
+      if (ha.WireID().Wire != hb.WireID().Wire)
+        return ha.WireID().Wire < hb.WireID().Wire;
+      if (ha.PeakTime() != hb.PeakTime())
+        return ha.PeakTime() < hb.PeakTime();
+      return a < b;
+    });
+
+    size_t bits = 0;
+    while ((size_t(1) << bits) < sorted.size()) {
+      ++bits;
+    }
+
+    std::vector<size_t> order;
+    order.reserve(sorted.size());
+    for (size_t i = 0; i < (size_t(1) << bits); ++i) {
+      size_t r = 0; // bit-reversed i
+      for (size_t b = 0; b < bits; ++b) {
+        if (i & (size_t(1) << b))
+          r |= size_t(1) << (bits - 1 - b);
+      }
+      if (r < sorted.size())
+        order.push_back(sorted[r]);
+    }
+    return order;
+  }
+
   // make sure fMVAWriter is getting a variable string
   template <size_t N>
   EmTrack<N>::EmTrack(EmTrack::Config const& config,
                       std::string const& module_label,
-                      art::ProducesCollector& collector)
-    : fBatchSize(config.BatchSize())
-    , fPointIdAlgTool(art::make_tool<PointIdAlgTools::IPointIdAlg>(
-        config.PointIdAlg.get_PSet()))
-    , fMVAWriter(collector, "emtrkmichel")
+                      art::ProducesCollector& collector,
+                      std::string const& instance)
+    : fBatchSize("EmTrack",
+                 config.BatchSize(),
+                 config.BatchSizeCandidates(),
+                 config.BatchSizeTuningSamples(),
+                 config.BatchSizeHysteresis())
+    , fPointIdAlgTool(PointIdAlgTools::makePointIdAlgTool(config.PointIdAlg.get_PSet()))
+    , fMVAWriter(collector, instance)
     , fWireProducerLabel(config.WireLabel())
     , fHitModuleLabel(config.HitModuleLabel())
     , fClusterModuleLabel(config.ClusterModuleLabel())
@@ -405,6 +940,14 @@ namespace nnet {
     , fDoClusters(!fClusterModuleLabel.label().empty())
     , fDoTracks(!fTrackModuleLabel.label().empty())
     , fViews(config.Views())
+    , fHitsInClusters(false)
+    , fHitsInTracks(false)
+    , fClusterScoreTolerance(config.ClusterScoreTolerance())
+    , fClusterScoreZ(config.ClusterScoreZ())
+    , fClusterScoreMinHits(config.ClusterScoreMinHits())
+    , fClusterScoreMaxHits(config.ClusterScoreMaxHits())
+    , fClusterScoreBatchSize(
+        std::max<size_t>(1, config.ClusterScoreBatchSize()))
     , fNewClustersTag(
         module_label,
         "",
@@ -412,6 +955,33 @@ namespace nnet {
   {
     fMVAWriter.template produces_using<recob::Hit>();
 
+    auto const& labels = fPointIdAlgTool->outputLabels();
+    auto const sizes = fPointIdAlgTool->modelOutputSizes();
+    auto const& instances = config.ModelInstances();
+    if (sizes.size() != instances.size() + 1) {
+      throw cet::exception("EmTrack")
+        << "ModelInstances: " << instances.size() << " names for "
+        << sizes.size() << " models, expected one for each model after the "
+        << "first." << std::endl;
+    }
+    if ((sizes.size() > 1) && (sizes.front() != N)) {
+      throw cet::exception("EmTrack")
+        << "first model has " << sizes.front() << " outputs, expected " << N
+        << "." << std::endl;
+    }
+    if (sizes.size() == 1) { fOutputLabels = labels; }
+    else {
+      fOutputLabels.assign(labels.begin(), labels.begin() + N);
+    }
+    for (size_t m = 1, idx = N; m < sizes.size(); idx += sizes[m++]) {
+      fModelOutputs.push_back(makeModelOutput(
+        sizes[m],
+        collector,
+        instances[m - 1],
+        std::vector<std::string>(labels.begin() + idx,
+                                 labels.begin() + idx + sizes[m])));
+    }
+
     if (!fClusterModuleLabel.label().empty()) {
       collector.produces<std::vector<recob::Cluster>>();
       collector.produces<art::Assns<recob::Cluster, recob::Hit>>();
@@ -422,6 +992,27 @@ namespace nnet {
     if (!fTrackModuleLabel.label().empty()) {
       fMVAWriter.template produces_using<recob::Track>();
     }
+
+    auto const selection = config.HitSelection();
+    if (selection == "clusters" || selection == "clustersAndTracks") {
+      fHitsInClusters = true;
+    }
+    if (selection == "tracks" || selection == "clustersAndTracks") {
+      fHitsInTracks = true;
+    }
+    if ((selection != "all") && !fHitsInClusters && !fHitsInTracks) {
+      throw cet::exception("EmTrack")
+        << "HitSelection \"" << selection << "\" not recognized." << std::endl;
+    }
+    if ((fClusterScoreTolerance > 0) && !fDoClusters) {
+      throw cet::exception("EmTrack")
+        << "ClusterScoreTolerance requires ClusterModuleLabel." << std::endl;
+    }
+    if ((fHitsInClusters && !fDoClusters) || (fHitsInTracks && !fDoTracks)) {
+      throw cet::exception("EmTrack")
+        << "HitSelection \"" << selection
+        << "\" requires the corresponding input module label." << std::endl;
+    }
   }
   // ------------------------------------------------------
 
@@ -436,14 +1027,19 @@ namespace nnet {
     std::vector<art::Ptr<recob::Hit>> hitPtrList;
     art::fill_ptr_vector(hitPtrList, hitListHandle);
     const EmTrack::cryo_tpc_view_keymap hitMap = create_hitmap(hitPtrList);
-    const std::vector<char> hitInFA = classify_hits(evt, hitMap, hitPtrList);
+    const std::vector<char> hitSelected = select_hits(evt, hitPtrList.size());
+    const std::vector<char> hitInFA =
+      classify_hits(evt, hitMap, hitPtrList, hitSelected);
 
     if (fDoClusters)
       make_clusters(evt, hitPtrList, hitInFA, hitMap);
 
     if (fDoTracks)
-      make_tracks(evt, hitInFA);
+      make_tracks(evt, hitPtrList, hitInFA);
     fMVAWriter.template saveOutputs(evt);
+    for (auto& mo : fModelOutputs) {
+      mo->save(evt);
+    }
   }
   // ------------------------------------------------------
 
@@ -17,6 +17,7 @@
 #include "art/Framework/Core/ModuleMacros.h"
 #include "art/Framework/Principal/Event.h"
 #include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Principal/Run.h"
 #include "art_root_io/TFileService.h"
 #include "canvas/Utilities/InputTag.h"
 #include "fhiclcpp/ParameterSet.h"
@@ -29,6 +30,7 @@
 #include "lardataobj/Simulation/SimChannel.h"
 #include "larevt/CalibrationDBI/Interface/ChannelStatusProvider.h"
 #include "larevt/CalibrationDBI/Interface/ChannelStatusService.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/ChannelInfoTable.h"
 
 #include "TEfficiency.h"
 #include "TH1D.h"
@@ -56,6 +58,7 @@ public:
 
 private:
   void beginJob() override;
+  void beginRun(art::Run const& run) override;
   void endJob() override;
   bool isSignalInROI(int starttick, int endtick, int maxtick, int roistart, int roiend);
   // Declare member data here.
@@ -79,6 +82,8 @@ private:
 
   int fCount_Roi_sig[3] = {0, 0, 0};
   int fCount_Roi_total[3] = {0, 0, 0};
+
+  nnet::ChannelInfoTable fChannels;
 };
 
 nnet::EvaluateROIEff::EvaluateROIEff(fhicl::ParameterSet const& p)
@@ -94,11 +99,11 @@ void
 nnet::EvaluateROIEff::analyze(art::Event const& e)
 {
 
-  auto const* geo = lar::providerFrom<geo::Geometry>();
   auto const clockData = art::ServiceHandle<detinfo::DetectorClocksService>()->DataFor(e);
   auto const detProp =
     art::ServiceHandle<detinfo::DetectorPropertiesService>()->DataFor(e, clockData);
   auto const& chStatus = art::ServiceHandle<lariov::ChannelStatusService>()->GetProvider();
+  fChannels.updateStatus(chStatus);
 
   art::Handle<std::vector<recob::Wire>> wireListHandle;
   std::vector<art::Ptr<recob::Wire>> wires;
@@ -114,10 +119,10 @@ nnet::EvaluateROIEff::analyze(art::Event const& e)
 
     // .. get simChannel channel number
     const raw::ChannelID_t ch1 = channel.Channel();
-    if (chStatus.IsBad(ch1)) continue;
+    if (fChannels.isBad(ch1)) continue;
 
     if (ch1 % 1000 == 0) mf::LogInfo("EvaluateROIEFF") << ch1;
-    int view = geo->View(ch1);
+    int view = fChannels.view(ch1);
     auto const& timeSlices = channel.TDCIDEMap();
 
     // time slice from simChannel is for individual tick
@@ -286,7 +291,7 @@ nnet::EvaluateROIEff::analyze(art::Event const& e)
 
   for (auto& wire : wires) {
     const raw::ChannelID_t wirechannel = wire->Channel();
-    if (chStatus.IsBad(wirechannel)) continue;
+    if (fChannels.isBad(wirechannel)) continue;
 
     int view = wire->View();
 
@@ -417,6 +422,12 @@ nnet::EvaluateROIEff::analyze(art::Event const& e)
   }
 }
 
+void
+nnet::EvaluateROIEff::beginRun(art::Run const&)
+{
+  fChannels.update(*lar::providerFrom<geo::Geometry>());
+}
+
 void
 nnet::EvaluateROIEff::beginJob()
 {
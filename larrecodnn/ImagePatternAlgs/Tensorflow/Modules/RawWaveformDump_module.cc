@@ -29,7 +29,6 @@
 
 // LArSoft libraries
 #include "larcore/Geometry/Geometry.h"
-#include "larcorealg/Geometry/PlaneGeo.h"
 #include "larcoreobj/SimpleTypesAndConstants/RawTypes.h" // raw::ChannelID_t
 #include "lardata/DetectorInfoServices/DetectorClocksService.h"
 #include "lardata/DetectorInfoServices/DetectorPropertiesService.h"
@@ -38,6 +37,7 @@
 #include "lardataobj/RecoBase/Hit.h"
 #include "lardataobj/RecoBase/Wire.h"
 #include "lardataobj/Simulation/SimChannel.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/ChannelInfoTable.h"
 #include "larsim/MCCheater/ParticleInventoryService.h"
 #include "nusimdata/SimulationBase/MCParticle.h"
 #include "nusimdata/SimulationBase/MCTruth.h"
@@ -90,6 +90,7 @@ public:
   //void reconfigure(fhicl::ParameterSet const & p);
 
   void beginJob() override;
+  void beginRun(art::Run const& run) override;
   void endJob() override;
 
 private:
@@ -112,6 +113,7 @@ private:
   int fMaxNumberOfElectrons;
   bool fSaveSignal;
   art::ServiceHandle<geo::Geometry> fgeom;
+  nnet::ChannelInfoTable fChannels;
   art::ServiceHandle<cheat::ParticleInventoryService> PIS;
 
   std::default_random_engine rndm_engine;
@@ -195,6 +197,13 @@ nnet::RawWaveformDump::RawWaveformDump(fhicl::ParameterSet const& p)
   //this->reconfigure(p);
 }
 
+//-----------------------------------------------------------------------
+void
+nnet::RawWaveformDump::beginRun(art::Run const&)
+{
+  fChannels.update(*fgeom);
+}
+
 //-----------------------------------------------------------------------
 void
 nnet::RawWaveformDump::beginJob()
@@ -286,9 +295,10 @@ nnet::RawWaveformDump::analyze(art::Event const& evt)
   if (rawdigitlist.empty() && wirelist.empty()) return;
   if (rawdigitlist.size() && wirelist.size()) return;
 
-  // channel status
+  // channel status, may change with the event time
   lariov::ChannelStatusProvider const& channelStatus =
     art::ServiceHandle<lariov::ChannelStatusService const>()->GetProvider();
+  fChannels.updateStatus(channelStatus);
 
   auto const clockData = art::ServiceHandle<detinfo::DetectorClocksService const>()->DataFor(evt);
   auto const detProp =
@@ -378,7 +388,7 @@ nnet::RawWaveformDump::analyze(art::Event const& evt)
       // .. get simChannel channel number
       const raw::ChannelID_t ch1 = channel.Channel();
       if (ch1 == raw::InvalidChannelID) continue;
-      if (geo::PlaneGeo::ViewName(fgeom->View(ch1)) != fPlaneToDump[0]) continue;
+      if (fChannels.viewName(ch1) != fPlaneToDump[0]) continue;
 
       bool selectThisChannel = false;
 
@@ -506,7 +516,7 @@ nnet::RawWaveformDump::analyze(art::Event const& evt)
 
           c2numpy_uint32(&npywriter, evt.id().event());
           c2numpy_uint32(&npywriter, chnum);
-          c2numpy_string(&npywriter, geo::PlaneGeo::ViewName(fgeom->View(chnum)).c_str());
+          c2numpy_string(&npywriter, fChannels.viewNameString(chnum).c_str());
           c2numpy_uint16(&npywriter,
                          itchn->second.size()); // size of Trk2WSInfoMap, or number of peaks
 
@@ -604,28 +614,27 @@ nnet::RawWaveformDump::analyze(art::Event const& evt)
         if (signalMap[digitVec->Channel()]) continue;
 
         std::vector<short> rawadc(dataSize); // vector to hold uncompressed adc values later
-        if (geo::PlaneGeo::ViewName(fgeom->View(digitVec->Channel())) != fPlaneToDump[0]) continue;
+        if (fChannels.viewName(digitVec->Channel()) != fPlaneToDump[0]) continue;
         raw::Uncompress(digitVec->ADCs(), rawadc, digitVec->GetPedestal(), digitVec->Compression());
         for (size_t j = 0; j < rawadc.size(); ++j) {
           adcvec[j] = rawadc[j] - digitVec->GetPedestal();
         }
         c2numpy_uint32(&npywriter, evt.id().event());
         c2numpy_uint32(&npywriter, digitVec->Channel());
-        c2numpy_string(&npywriter,
-                       geo::PlaneGeo::ViewName(fgeom->View(digitVec->Channel())).c_str());
+        c2numpy_string(&npywriter, fChannels.viewNameString(digitVec->Channel()).c_str());
       }
       else if (wirelist.size()) {
         art::Ptr<recob::Wire> wire = wirelist[rdIter];
         if (signalMap[wire->Channel()]) continue;
-        if (channelStatus.IsBad(wire->Channel())) continue;
-        if (geo::PlaneGeo::ViewName(fgeom->View(wire->Channel())) != fPlaneToDump[0]) continue;
+        if (fChannels.isBad(wire->Channel())) continue;
+        if (fChannels.viewName(wire->Channel()) != fPlaneToDump[0]) continue;
         const auto& signal = wire->Signal();
         for (size_t j = 0; j < adcvec.size(); ++j) {
           adcvec[j] = signal[j];
         }
         c2numpy_uint32(&npywriter, evt.id().event());
         c2numpy_uint32(&npywriter, wire->Channel());
-        c2numpy_string(&npywriter, geo::PlaneGeo::ViewName(fgeom->View(wire->Channel())).c_str());
+        c2numpy_string(&npywriter, fChannels.viewNameString(wire->Channel()).c_str());
       }
 
       c2numpy_uint16(&npywriter, 0); //number of peaks
@@ -28,8 +28,12 @@
 #include "lardataobj/RawData/RawDigit.h"
 #include "lardataobj/RawData/raw.h"
 #include "lardataobj/RecoBase/Wire.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/BatchSizeTuner.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/ChannelInfoTable.h"
 #include "larrecodnn/ImagePatternAlgs/Tensorflow/WaveformRecogTools/IWaveformRecog.h"
 
+#include <chrono>
+#include <map>
 #include <memory>
 
 namespace nnet {
@@ -50,6 +54,7 @@ public:
 
   // Required functions.
   void produce(art::Event& e) override;
+  void beginRun(art::Run& run) override;
 
 private:
   art::InputTag fRawProducerLabel;
@@ -59,12 +64,19 @@ private:
 
   int fNPlanes;
   unsigned int fWaveformSize; // Full waveform size
+  nnet::BatchSizeTuner fBatchSize; // number of waveforms passed to the CNN together
+  nnet::ChannelInfoTable fChannels;
 };
 
 nnet::WaveformRoiFinder::WaveformRoiFinder(fhicl::ParameterSet const& p)
   : EDProducer{p}
   , fRawProducerLabel(p.get<art::InputTag>("RawProducerLabel", ""))
   , fWireProducerLabel(p.get<art::InputTag>("WireProducerLabel", ""))
+  , fBatchSize("WaveformRoiFinder",
+               p.get<size_t>("BatchSize", 1),
+               p.get<std::vector<size_t>>("BatchSizeCandidates", {}),
+               p.get<size_t>("BatchSizeTuningSamples", 1000),
+               p.get<float>("BatchSizeHysteresis", 0.05))
 {
   // use either raw waveform or recob waveform
   if (fRawProducerLabel.empty() && fWireProducerLabel.empty()) {
@@ -91,6 +103,12 @@ nnet::WaveformRoiFinder::WaveformRoiFinder(fhicl::ParameterSet const& p)
   produces<std::vector<recob::Wire>>();
 }
 
+void
+nnet::WaveformRoiFinder::beginRun(art::Run&)
+{
+  fChannels.update(*lar::providerFrom<geo::Geometry>());
+}
+
 void
 nnet::WaveformRoiFinder::produce(art::Event& e)
 {
@@ -105,79 +123,110 @@ nnet::WaveformRoiFinder::produce(art::Event& e)
 
   std::unique_ptr<std::vector<recob::Wire>> outwires(new std::vector<recob::Wire>);
 
-  auto const* geo = lar::providerFrom<geo::Geometry>();
-
   //##############################
   //### Looping over the wires ###
   //##############################
-  for (unsigned int ich = 0; ich < (rawlist.empty() ? wirelist.size() : rawlist.size()); ++ich) {
+  size_t const nch = rawlist.empty() ? wirelist.size() : rawlist.size();
+  for (size_t ich0 = 0; ich0 < nch;) {
+    size_t const batch = fBatchSize.batchSize();
+    size_t const ich1 = std::min(ich0 + batch, nch);
+    auto const t0 = std::chrono::steady_clock::now();
 
-    std::vector<float> inputsignal(fWaveformSize);
+    std::vector<std::vector<float>> inputsignals(ich1 - ich0, std::vector<float>(fWaveformSize));
+    std::vector<int> views(ich1 - ich0, -1);
+    for (size_t ich = ich0; ich < ich1; ++ich) {
+      auto& inputsignal = inputsignals[ich - ich0];
 
-    int view = -1;
+      if (!wirelist.empty()) {
+        const auto& wire = wirelist[ich];
+        const auto& signal = wire->Signal();
 
-    if (!wirelist.empty()) {
-      const auto& wire = wirelist[ich];
-      const auto& signal = wire->Signal();
+        views[ich - ich0] = wire->View();
 
-      view = wire->View();
+        for (size_t itck = 0; itck < inputsignal.size(); ++itck) {
+          inputsignal[itck] = signal[itck];
+        }
+      }
+      else if (!rawlist.empty()) {
+        const auto& digitVec = rawlist[ich];
 
-      for (size_t itck = 0; itck < inputsignal.size(); ++itck) {
-        inputsignal[itck] = signal[itck];
+        views[ich - ich0] = fChannels.view(rawlist[ich]->Channel());
+
+        std::vector<short> rawadc(fWaveformSize);
+        raw::Uncompress(digitVec->ADCs(), rawadc, digitVec->GetPedestal(), digitVec->Compression());
+        for (size_t itck = 0; itck < rawadc.size(); ++itck) {
+          inputsignal[itck] = rawadc[itck] - digitVec->GetPedestal();
+        }
       }
     }
-    else if (!rawlist.empty()) {
-      const auto& digitVec = rawlist[ich];
 
-      view = geo->View(rawlist[ich]->Channel());
+    // ... use waveform recognition CNN to perform inference on each window, windows of all
+    // waveforms of the same view in one batch
+    std::map<int, std::vector<size_t>> viewidx;
+    for (size_t i = 0; i < views.size(); ++i) {
+      viewidx[views[i]].push_back(i);
+    }
+    std::vector<std::vector<bool>> inrois(ich1 - ich0);
+    for (auto const& [view, idx] : viewidx) {
+      std::vector<std::vector<float>> viewsignals;
+      for (size_t i : idx) {
+        viewsignals.push_back(std::move(inputsignals[i]));
+      }
 
-      std::vector<short> rawadc(fWaveformSize);
-      raw::Uncompress(digitVec->ADCs(), rawadc, digitVec->GetPedestal(), digitVec->Compression());
-      for (size_t itck = 0; itck < rawadc.size(); ++itck) {
-        inputsignal[itck] = rawadc[itck] - digitVec->GetPedestal();
+      auto viewrois = fWaveformRecogToolVec[view]->findROIs(viewsignals);
+      for (size_t k = 0; k < idx.size(); ++k) {
+        inputsignals[idx[k]] = std::move(viewsignals[k]);
+        inrois[idx[k]] = std::move(viewrois[k]);
       }
     }
 
-    // ... use waveform recognition CNN to perform inference on each window
-    std::vector<bool> inroi(fWaveformSize, false);
-    inroi = fWaveformRecogToolVec[view]->findROI(inputsignal);
+    for (size_t ich = ich0; ich < ich1; ++ich) {
+      const auto& inputsignal = inputsignals[ich - ich0];
+      const auto& inroi = inrois[ich - ich0];
 
-    std::vector<float> sigs;
-    int lastsignaltick = -1;
-    int roistart = -1;
+      std::vector<float> sigs;
+      int lastsignaltick = -1;
+      int roistart = -1;
 
-    recob::Wire::RegionsOfInterest_t rois(fWaveformSize);
+      recob::Wire::RegionsOfInterest_t rois(fWaveformSize);
 
-    for (size_t i = 0; i < fWaveformSize; ++i) {
-      if (inroi[i]) {
-        if (sigs.empty()) {
-          sigs.push_back(inputsignal[i]);
-          lastsignaltick = i;
-          roistart = i;
-        }
-        else {
-          if (int(i) != lastsignaltick + 1) {
-            rois.add_range(roistart, std::move(sigs));
-            sigs.clear();
+      for (size_t i = 0; i < fWaveformSize; ++i) {
+        if (inroi[i]) {
+          if (sigs.empty()) {
             sigs.push_back(inputsignal[i]);
             lastsignaltick = i;
             roistart = i;
           }
           else {
-            sigs.push_back(inputsignal[i]);
-            lastsignaltick = i;
+            if (int(i) != lastsignaltick + 1) {
+              rois.add_range(roistart, std::move(sigs));
+              sigs.clear();
+              sigs.push_back(inputsignal[i]);
+              lastsignaltick = i;
+              roistart = i;
+            }
+            else {
+              sigs.push_back(inputsignal[i]);
+              lastsignaltick = i;
+            }
           }
         }
       }
+      if (!sigs.empty()) { rois.add_range(roistart, std::move(sigs)); }
+      if (!wirelist.empty()) {
+        outwires->emplace_back(recob::Wire(rois, wirelist[ich]->Channel(), wirelist[ich]->View()));
+      }
+      else if (!rawlist.empty()) {
+        outwires->emplace_back(
+          recob::Wire(rois, rawlist[ich]->Channel(), fChannels.view(rawlist[ich]->Channel())));
+      }
     }
-    if (!sigs.empty()) { rois.add_range(roistart, std::move(sigs)); }
-    if (!wirelist.empty()) {
-      outwires->emplace_back(recob::Wire(rois, wirelist[ich]->Channel(), wirelist[ich]->View()));
-    }
-    else if (!rawlist.empty()) {
-      outwires->emplace_back(
-        recob::Wire(rois, rawlist[ich]->Channel(), geo->View(rawlist[ich]->Channel())));
-    }
+
+    fBatchSize.record(
+      batch,
+      ich1 - ich0,
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+    ich0 = ich1;
   }
 
   e.put(std::move(outwires));
@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       BatchSizeTuner
+//
+// Chooses the batch size of a module at run time: each candidate is used until at least
+// minSamples samples are processed in full batches, then the candidate with the best throughput
+// is kept. The configured batch size is kept unless another candidate is faster by more than the
+// hysteresis fraction. The very first batch (initialization of the backend) is not measured.
+// A candidate larger than the typical number of samples (e.g. hits in a plane) would never
+// fill a batch: it is dropped after maxPartial batches in a row that were not full.
+// Without candidates the configured batch size is used as it is.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BatchSizeTuner_h
+#define BatchSizeTuner_h
+
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nnet {
+
+  class BatchSizeTuner {
+  public:
+    BatchSizeTuner(std::string const& name,
+                   size_t batchSize,
+                   std::vector<size_t> const& candidates = {},
+                   size_t minSamples = 4096,
+                   float hysteresis = 0.05F,
+                   size_t maxPartial = 20)
+      : fName(name)
+      , fBatchSize(std::max<size_t>(1, batchSize))
+      , fMinSamples(minSamples)
+      , fHysteresis(hysteresis)
+      , fMaxPartial(std::max<size_t>(1, maxPartial))
+      , fCurrent(0)
+    {
+      for (size_t b : candidates) {
+        if (b > 0) { fCandidates.push_back(b); }
+      }
+      if (!fCandidates.empty() &&
+          (std::find(fCandidates.begin(), fCandidates.end(), fBatchSize) == fCandidates.end())) {
+        fCandidates.push_back(fBatchSize);
+      }
+      fSamples.resize(fCandidates.size(), 0);
+      fSeconds.resize(fCandidates.size(), 0);
+    }
+
+    bool
+    tuning() const
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      return fCurrent < fCandidates.size();
+    }
+
+    size_t
+    batchSize() const
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      return (fCurrent < fCandidates.size()) ? fCandidates[fCurrent] : fBatchSize;
+    }
+
+    /// time of a batch of the given size, only full batches of the current candidate count
+    void
+    record(size_t batchSize, size_t samples, double seconds)
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      if ((fCurrent >= fCandidates.size()) || (batchSize != fCandidates[fCurrent])) { return; }
+      if (samples != batchSize) {
+        if (++fPartial >= fMaxPartial) {
+          mf::LogInfo(fName) << "Batch size " << batchSize << " dropped, " << fPartial
+                             << " batches in a row were not full.";
+          fSamples[fCurrent] = 0;
+          fSeconds[fCurrent] = 0; // not chosen
+          next();
+        }
+        return;
+      }
+      fPartial = 0;
+      if (!fWarm) {
+        fWarm = true;
+        return;
+      }
+
+      fSamples[fCurrent] += samples;
+      fSeconds[fCurrent] += seconds;
+      if (fSamples[fCurrent] >= fMinSamples) { next(); }
+    }
+
+  private:
+    void
+    next()
+    {
+      fPartial = 0;
+      if (++fCurrent == fCandidates.size()) { choose(); }
+    }
+
+    double
+    throughput(size_t i) const
+    {
+      return (fSeconds[i] > 0) ? fSamples[i] / fSeconds[i] : 0;
+    }
+
+    void
+    choose()
+    {
+      size_t best = 0, configured = 0;
+      for (size_t i = 0; i < fCandidates.size(); ++i) {
+        if (throughput(i) > throughput(best)) { best = i; }
+        if (fCandidates[i] == fBatchSize) { configured = i; }
+      }
+      if (throughput(best) > (1 + fHysteresis) * throughput(configured)) {
+        fBatchSize = fCandidates[best];
+      }
+      else {
+        best = configured;
+      }
+
+      mf::LogInfo log(fName);
+      log << "Batch size " << fBatchSize << " chosen, " << throughput(best)
+          << " samples/s; measured:";
+      for (size_t i = 0; i < fCandidates.size(); ++i) {
+        log << " " << fCandidates[i] << ": " << throughput(i) << "/s";
+      }
+    }
+
+    std::string const fName;
+    size_t fBatchSize;
+    std::vector<size_t> fCandidates;
+    size_t const fMinSamples;
+    float const fHysteresis;
+    size_t const fMaxPartial;
+
+    mutable std::mutex fMutex;
+    size_t fCurrent;
+    bool fWarm = false;
+    size_t fPartial = 0; // batches of the current candidate in a row that were not full
+    std::vector<size_t> fSamples;
+    std::vector<double> fSeconds;
+  };
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       ChannelInfoTable
+//
+// See ChannelInfoTable.h
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/ChannelInfoTable.h"
+
+#include "larcorealg/Geometry/GeometryCore.h"
+#include "larcorealg/Geometry/PlaneGeo.h"
+#include "larevt/CalibrationDBI/Interface/ChannelStatusProvider.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+bool
+nnet::ChannelInfoTable::update(geo::GeometryCore const& geom)
+{
+  if ((&geom == fGeometry) && (geom.DetectorName() == fDetectorName) &&
+      (geom.Nchannels() == fChannels.size())) {
+    return false;
+  }
+
+  fGeometry = &geom;
+  fDetectorName = geom.DetectorName();
+
+  for (size_t v = 0; v < fViewNames.size(); ++v) {
+    fViewNames[v] = geo::PlaneGeo::ViewName(static_cast<geo::View_t>(v));
+  }
+
+  fChannels.assign(geom.Nchannels(), ChannelInfo());
+  for (raw::ChannelID_t ch = 0; ch < fChannels.size(); ++ch) {
+    auto& info = fChannels[ch];
+    info.view = geom.View(ch);
+    info.viewName = fViewNames[info.view].empty() ? '?' : fViewNames[info.view][0];
+    auto const wires = geom.ChannelToWire(ch);
+    if (!wires.empty()) { info.plane = wires.front().asPlaneID(); }
+  }
+  fBad.clear();
+  fNoisy.clear();
+
+  mf::LogInfo("ChannelInfoTable") << "Channel table built: " << fChannels.size() << " channels.";
+  return true;
+}
+
+// ------------------------------------------------------
+bool
+nnet::ChannelInfoTable::updateStatus(lariov::ChannelStatusProvider const& status)
+{
+  auto bad = status.BadChannels();
+  auto noisy = status.NoisyChannels();
+  if ((bad == fBad) && (noisy == fNoisy)) { return false; }
+
+  for (auto ch : fBad) {
+    if (ch < fChannels.size()) { fChannels[ch].bad = false; }
+  }
+  for (auto ch : fNoisy) {
+    if (ch < fChannels.size()) { fChannels[ch].noisy = false; }
+  }
+  fBad = std::move(bad);
+  fNoisy = std::move(noisy);
+  for (auto ch : fBad) {
+    if (ch < fChannels.size()) { fChannels[ch].bad = true; }
+  }
+  for (auto ch : fNoisy) {
+    if (ch < fChannels.size()) { fChannels[ch].noisy = true; }
+  }
+
+  mf::LogInfo("ChannelInfoTable") << "Channel status updated: " << fBad.size() << " bad, "
+                                  << fNoisy.size() << " noisy.";
+  return true;
+}
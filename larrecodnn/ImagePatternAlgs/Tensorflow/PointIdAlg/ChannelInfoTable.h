@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       ChannelInfoTable
+//
+// Dense table of channel metadata (view, plane, view name, bad/noisy status) indexed by the
+// channel number, so modules look it up in their per-channel loops instead of calling the
+// geometry and channel status providers. update() is meant to be called at the beginning of
+// each run, it rebuilds the geometry part if the geometry changed. updateStatus() is called on
+// each event, since database providers may change the status with the event time; it costs a
+// copy of the bad/noisy sets, the flags are touched only when the sets changed. Not thread-safe,
+// each module keeps its own table.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ChannelInfoTable_h
+#define ChannelInfoTable_h
+
+#include "larcoreobj/SimpleTypesAndConstants/RawTypes.h"
+#include "larcoreobj/SimpleTypesAndConstants/geo_types.h"
+
+#include <array>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace geo {
+  class GeometryCore;
+}
+namespace lariov {
+  class ChannelStatusProvider;
+}
+
+namespace nnet {
+
+  class ChannelInfoTable {
+  public:
+    struct ChannelInfo {
+      geo::View_t view = geo::kUnknown;
+      geo::PlaneID plane; // first plane read by the channel, invalid if none
+      char viewName = '?';
+      bool bad = false;
+      bool noisy = false;
+    };
+
+    /// rebuild the geometry part if the geometry changed since the last call; returns true if
+    /// the table was rebuilt, the bad/noisy flags are then cleared
+    bool update(geo::GeometryCore const& geom);
+
+    /// set the bad/noisy flags if the sets of the provider differ from the last call;
+    /// returns true if the flags changed
+    bool updateStatus(lariov::ChannelStatusProvider const& status);
+
+    size_t
+    size() const
+    {
+      return fChannels.size();
+    }
+
+    /// channels out of the geometry range get the default (unknown view, invalid plane)
+    ChannelInfo const&
+    operator[](raw::ChannelID_t ch) const
+    {
+      return (ch < fChannels.size()) ? fChannels[ch] : fInvalid;
+    }
+
+    geo::View_t
+    view(raw::ChannelID_t ch) const
+    {
+      return (*this)[ch].view;
+    }
+    geo::PlaneID const&
+    plane(raw::ChannelID_t ch) const
+    {
+      return (*this)[ch].plane;
+    }
+    char
+    viewName(raw::ChannelID_t ch) const
+    {
+      return (*this)[ch].viewName;
+    }
+    /// same as geo::PlaneGeo::ViewName(view(ch)), without building a string
+    std::string const&
+    viewNameString(raw::ChannelID_t ch) const
+    {
+      return fViewNames[view(ch)];
+    }
+    bool
+    isBad(raw::ChannelID_t ch) const
+    {
+      return (*this)[ch].bad;
+    }
+    bool
+    isNoisy(raw::ChannelID_t ch) const
+    {
+      return (*this)[ch].noisy;
+    }
+
+  private:
+    std::vector<ChannelInfo> fChannels;
+    ChannelInfo const fInvalid{};
+    std::array<std::string, geo::kUnknown + 1> fViewNames;
+
+    // state used to detect changes
+    geo::GeometryCore const* fGeometry = nullptr;
+    std::string fDetectorName;
+    std::set<raw::ChannelID_t> fBad, fNoisy; // flags set in the table
+  };
+
+}
+
+#endif
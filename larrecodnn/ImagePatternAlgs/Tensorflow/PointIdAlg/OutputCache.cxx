@@ -0,0 +1,330 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       OutputCache
+//
+// See OutputCache.h
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/OutputCache.h"
+
+#include "cetlib/search_path.h"
+#include "cetlib_except/exception.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <numeric>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  constexpr std::uint64_t kOffset = 14695981039346656037ULL, kPrime = 1099511628211ULL;
+
+  constexpr char kMagic[8] = {'L', 'R', 'D', 'N', 'N', 'O', 'C', '1'};
+  constexpr std::uint32_t kVersion = 2; // records sorted by the key
+
+  // final mixing of the hash bits (splitmix64)
+  std::uint64_t
+  mix(std::uint64_t h)
+  {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+  }
+}
+
+// ------------------------------------------------------
+nnet::OutputCache::OutputCache(std::string const& fileName,
+                               std::uint64_t modelKey,
+                               std::string const& name,
+                               std::uint32_t nOutputs)
+  : fModelKey(modelKey), fName(name), fNOutputs(nOutputs)
+{
+  char suffix[24];
+  std::snprintf(suffix, sizeof(suffix), ".%016llx", static_cast<unsigned long long>(fModelKey));
+  fFileName = fileName + suffix;
+
+  if (fNOutputs > kMaxOutputs) {
+    throw cet::exception(fName) << "Output cache: " << fNOutputs << " outputs per sample, at most "
+                                << kMaxOutputs << " are supported.";
+  }
+  load();
+}
+
+// ------------------------------------------------------
+void
+nnet::OutputCache::load()
+{
+  int const fd = open(fFileName.c_str(), O_RDONLY);
+  struct stat st;
+  Header h;
+  if ((fd < 0) || (fstat(fd, &st) != 0) || (st.st_size < static_cast<off_t>(sizeof(Header))) ||
+      (pread(fd, &h, sizeof(h), 0) != sizeof(h))) {
+    if (fd >= 0) { close(fd); }
+    mf::LogInfo(fName) << "New output cache " << fFileName << ".";
+    return;
+  }
+  if (std::memcmp(h.magic, kMagic, sizeof(h.magic)) || (h.version != kVersion) ||
+      (h.modelKey != fModelKey) || (h.nOutputs == 0) || (h.nOutputs > kMaxOutputs) ||
+      (fNOutputs && (h.nOutputs != fNOutputs))) {
+    close(fd);
+    fEnabled = false;
+    mf::LogWarning(fName) << "File " << fFileName
+                          << " is not an output cache of this model, it is not used.";
+    return;
+  }
+  fNOutputs = h.nOutputs;
+
+  // only the pages touched by the lookups are read
+  fMapSize = st.st_size;
+  fMap = mmap(nullptr, fMapSize, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (fMap == MAP_FAILED) {
+    fMap = nullptr;
+    fEnabled = false;
+    mf::LogWarning(fName) << "Could not map the output cache " << fFileName
+                          << ", it is not used.";
+    return;
+  }
+  madvise(fMap, fMapSize, MADV_RANDOM);
+  fRecords = static_cast<unsigned char const*>(fMap) + sizeof(Header);
+  fNRecords = (fMapSize - sizeof(Header)) / recordSize(); // incomplete last record ignored
+
+  mf::LogInfo(fName) << "Output cache " << fFileName << ": " << fNRecords << " entries, "
+                     << fNOutputs << " outputs each.";
+}
+
+// ------------------------------------------------------
+nnet::OutputCache::~OutputCache()
+{
+  try {
+    flush();
+  }
+  catch (cet::exception const& e) {
+    mf::LogError(fName) << e.what();
+  }
+  size_t const hits = fHits, misses = fMisses;
+  if (hits + misses) {
+    mf::LogInfo(fName) << "Output cache " << fFileName << ": " << hits << " hits, " << misses
+                       << " misses, hit rate " << 100.0 * hits / (hits + misses) << "%.";
+  }
+  if (fMap) { munmap(fMap, fMapSize); }
+}
+
+// ------------------------------------------------------
+std::uint64_t
+nnet::OutputCache::hash(void const* data, size_t bytes, std::uint64_t h)
+{
+  // FNV-1a on 64-bit words, then on the remaining bytes
+  auto const* p = static_cast<unsigned char const*>(data);
+  size_t const words = bytes / sizeof(std::uint64_t);
+  for (size_t i = 0; i < words; ++i, p += sizeof(std::uint64_t)) {
+    std::uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    h = (h ^ w) * kPrime;
+  }
+  for (size_t i = words * sizeof(std::uint64_t); i < bytes; ++i, ++p) {
+    h = (h ^ *p) * kPrime;
+  }
+  return h;
+}
+
+// ------------------------------------------------------
+std::uint64_t
+nnet::OutputCache::modelKey(fhicl::ParameterSet const& pset)
+{
+  std::string const config = pset.to_string();
+  std::uint64_t h = hash(config.data(), config.size(), kOffset);
+
+  auto const model = pset.get<std::string>("NNetModelFile", "");
+  if (!model.empty()) {
+    std::string path;
+    cet::search_path sp("FW_SEARCH_PATH");
+    if (!sp.find_file(model, path)) { path = model; }
+    std::ifstream f(path, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    while (f.read(buffer.data(), buffer.size()) || f.gcount()) {
+      h = hash(buffer.data(), f.gcount(), h);
+    }
+  }
+  return mix(h);
+}
+
+// ------------------------------------------------------
+std::uint64_t
+nnet::OutputCache::key(std::vector<std::vector<float>> const& rows) const
+{
+  std::uint64_t h = (kOffset ^ fModelKey) * kPrime;
+  for (auto const& r : rows) {
+    h = hash(r.data(), r.size() * sizeof(float), h);
+  }
+  return mix(h);
+}
+
+std::uint64_t
+nnet::OutputCache::key(std::vector<float> const& sample) const
+{
+  std::uint64_t h = (kOffset ^ fModelKey) * kPrime;
+  return mix(hash(sample.data(), sample.size() * sizeof(float), h));
+}
+
+// ------------------------------------------------------
+size_t
+nnet::OutputCache::findRecord(std::uint64_t key) const
+{
+  size_t lo = 0, hi = fNRecords;
+  while (lo < hi) {
+    size_t const mid = lo + (hi - lo) / 2;
+    std::uint64_t k;
+    std::memcpy(&k, record(mid), sizeof(k));
+    if (k < key) { lo = mid + 1; }
+    else if (key < k) {
+      hi = mid;
+    }
+    else {
+      return mid;
+    }
+  }
+  return fNRecords;
+}
+
+bool
+nnet::OutputCache::find(std::uint64_t key, std::vector<float>& out) const
+{
+  size_t const i = findRecord(key); // the mapping is not modified after load
+  if (i < fNRecords) {
+    out.resize(fNOutputs);
+    std::memcpy(out.data(), record(i) + sizeof(std::uint64_t), fNOutputs * sizeof(float));
+    ++fHits;
+    return true;
+  }
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    auto const nit = fNewIndex.find(key);
+    if (nit != fNewIndex.end()) {
+      auto const first = fNewValues.begin() + nit->second * fNOutputs;
+      out.assign(first, first + fNOutputs);
+      ++fHits;
+      return true;
+    }
+  }
+  ++fMisses;
+  return false;
+}
+
+void
+nnet::OutputCache::insert(std::uint64_t key, std::vector<float> const& out)
+{
+  if (!fEnabled) { return; }
+  std::lock_guard<std::mutex> lock(fMutex);
+  if (!fNOutputs && !out.empty() && (out.size() <= kMaxOutputs)) { fNOutputs = out.size(); }
+  if (out.size() != fNOutputs) { return; }
+  if (findRecord(key) < fNRecords) { return; }
+  if (fNewIndex.emplace(key, fNewKeys.size()).second) {
+    fNewKeys.push_back(key);
+    fNewValues.insert(fNewValues.end(), out.begin(), out.end());
+  }
+}
+
+// ------------------------------------------------------
+void
+nnet::OutputCache::flush()
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  if (!fEnabled || (fFlushed == fNewKeys.size())) { return; }
+
+  // one writer at a time; the cache file itself is replaced, so the lock is on a separate file
+  std::string const lockName = fFileName + ".lock";
+  int const lockFd = open(lockName.c_str(), O_RDWR | O_CREAT, 0644);
+  if ((lockFd < 0) || (flock(lockFd, LOCK_EX) != 0)) {
+    if (lockFd >= 0) { close(lockFd); }
+    throw cet::exception(fName) << "Could not lock the output cache " << lockName << ".";
+  }
+
+  std::string const tmpName = fFileName + ".tmp";
+  FILE* old = std::fopen(fFileName.c_str(), "rb"); // may be newer than the mapped one
+  FILE* out = nullptr;
+  auto const fail = [&](std::string const& what) {
+    if (old) { std::fclose(old); }
+    if (out) {
+      std::fclose(out);
+      std::remove(tmpName.c_str()); // the cache file is not touched
+    }
+    flock(lockFd, LOCK_UN);
+    close(lockFd);
+    fEnabled = false;
+    return cet::exception(fName) << what << " " << fFileName << ".";
+  };
+
+  Header h;
+  if (old && (std::fread(&h, sizeof(h), 1, old) == 1)) {
+    if (std::memcmp(h.magic, kMagic, sizeof(h.magic)) || (h.version != kVersion) ||
+        (h.modelKey != fModelKey) || (h.nOutputs != fNOutputs)) {
+      throw fail("New entries not written, header does not match, output cache");
+    }
+  }
+  else { // no file yet, or a bare header
+    std::memcpy(h.magic, kMagic, sizeof(h.magic));
+    h.version = kVersion;
+    h.nOutputs = fNOutputs;
+    h.modelKey = fModelKey;
+  }
+
+  std::vector<size_t> order(fNewKeys.size() - fFlushed);
+  std::iota(order.begin(), order.end(), fFlushed);
+  std::sort(
+    order.begin(), order.end(), [this](size_t a, size_t b) { return fNewKeys[a] < fNewKeys[b]; });
+
+  out = std::fopen(tmpName.c_str(), "wb");
+  if (!out) { throw fail("Could not create the new output cache"); }
+  bool ok = (std::fwrite(&h, sizeof(h), 1, out) == 1);
+
+  // merge of two sorted sequences, entries already in the file are kept
+  size_t const rs = recordSize();
+  std::vector<unsigned char> rec(rs);
+  std::uint64_t oldKey = 0;
+  auto const readOld = [&]() {
+    if (old && (std::fread(rec.data(), rs, 1, old) == 1)) {
+      std::memcpy(&oldKey, rec.data(), sizeof(oldKey));
+      return true;
+    }
+    return false; // end, or incomplete last record
+  };
+  bool haveOld = readOld();
+  size_t added = 0;
+  for (auto it = order.begin(); ok && ((it != order.end()) || haveOld);) {
+    if ((it == order.end()) || (haveOld && (oldKey <= fNewKeys[*it]))) {
+      if ((it != order.end()) && (oldKey == fNewKeys[*it])) { ++it; }
+      ok = (std::fwrite(rec.data(), rs, 1, out) == 1);
+      haveOld = readOld();
+    }
+    else {
+      ok = (std::fwrite(&fNewKeys[*it], sizeof(std::uint64_t), 1, out) == 1) &&
+           (std::fwrite(&fNewValues[*it * fNOutputs], sizeof(float), fNOutputs, out) ==
+            fNOutputs);
+      ++added;
+      ++it;
+    }
+  }
+  ok = ok && (!old || !std::ferror(old)) && (std::fflush(out) == 0) && (fsync(fileno(out)) == 0);
+  if (!ok) { throw fail("Could not write new entries to the output cache"); }
+  bool const closed = (std::fclose(out) == 0);
+  out = nullptr;
+  if (!closed || (std::rename(tmpName.c_str(), fFileName.c_str()) != 0)) {
+    std::remove(tmpName.c_str());
+    throw fail("Could not replace the output cache");
+  }
+  if (old) { std::fclose(old); }
+  flock(lockFd, LOCK_UN);
+  close(lockFd);
+
+  mf::LogInfo(fName) << added << " entries added to the output cache " << fFileName << ".";
+  fFlushed = fNewKeys.size();
+}
@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       OutputCache
+//
+// On-disk store of network outputs keyed by a hash of the model (file content and tool
+// configuration) and of the input sample (patch or waveform window), so reprocessing the same
+// data fetches stored outputs instead of running the inference again. Each model has its own
+// file, <fileName>.<model key in hex>: a header (magic, version, model key, number of outputs)
+// followed by fixed-size records (key, outputs) sorted by the key. The file is mapped to memory
+// and looked up with a binary search, so memory and startup time do not grow with the file.
+// New entries are merged into a sorted copy that replaces the file when the cache is closed;
+// <fileName>.<model key>.lock serializes the jobs sharing the file, readers see either the old
+// or the new file. Keys are 64-bit, a collision between different inputs is possible but very
+// unlikely.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef OutputCache_h
+#define OutputCache_h
+
+#include "fhiclcpp/ParameterSet.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nnet {
+
+  class OutputCache {
+  public:
+    static constexpr std::uint32_t kMaxOutputs = 64; // sanity bound of the outputs per sample
+
+    /// name: used in the log messages; modelKey: see modelKey(); nOutputs: outputs per sample,
+    /// 0: taken from the file or from the first inserted entry
+    OutputCache(std::string const& fileName,
+                std::uint64_t modelKey,
+                std::string const& name,
+                std::uint32_t nOutputs = 0);
+    ~OutputCache(); // writes new entries, prints hit rate
+
+    OutputCache(OutputCache const&) = delete;
+    OutputCache& operator=(OutputCache const&) = delete;
+
+    /// hash of the model configuration and of the content of NNetModelFile, if it is there
+    static std::uint64_t modelKey(fhicl::ParameterSet const& pset);
+
+    static std::uint64_t hash(void const* data, size_t bytes, std::uint64_t h);
+
+    /// key of a sample given as a sequence of rows
+    std::uint64_t key(std::vector<std::vector<float>> const& rows) const;
+    std::uint64_t key(std::vector<float> const& sample) const;
+
+    bool find(std::uint64_t key, std::vector<float>& out) const;
+    void insert(std::uint64_t key, std::vector<float> const& out); // ignored if size differs
+
+    /// merge new entries into the file
+    void flush();
+
+  private:
+    struct Header {
+      char magic[8];
+      std::uint32_t version;
+      std::uint32_t nOutputs;
+      std::uint64_t modelKey;
+    };
+
+    void load();
+    size_t
+    recordSize() const
+    {
+      return sizeof(std::uint64_t) + fNOutputs * sizeof(float);
+    }
+    /// record of the mapped file, records are not aligned
+    unsigned char const*
+    record(size_t i) const
+    {
+      return fRecords + i * recordSize();
+    }
+    size_t findRecord(std::uint64_t key) const; // index in the mapped file, fNRecords if absent
+
+    std::string fFileName;
+    std::uint64_t fModelKey;
+    std::string fName;
+    std::uint32_t fNOutputs;
+    std::atomic<bool> fEnabled{true}; // false if the file belongs to something else
+
+    void* fMap = nullptr; // file mapped at startup, not modified afterwards
+    size_t fMapSize = 0;
+    unsigned char const* fRecords = nullptr;
+    size_t fNRecords = 0;
+
+    mutable std::mutex fMutex;
+    std::unordered_map<std::uint64_t, size_t> fNewIndex; // entries of this job
+    std::vector<std::uint64_t> fNewKeys;
+    std::vector<float> fNewValues;
+    size_t fFlushed = 0; // new entries already in the file
+
+    mutable std::atomic<size_t> fHits{0}, fMisses{0};
+  };
+
+}
+
+#endif
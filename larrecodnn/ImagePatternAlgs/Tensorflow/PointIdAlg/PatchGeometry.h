@@ -0,0 +1,80 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PatchGeometry
+//
+// Fiducial region bounds and drift scaling of the plane image used by PointIdAlg and the
+// IPointIdAlg tools. Computed once per plane (or batch of points) instead of for each point.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PatchGeometry_h
+#define PatchGeometry_h
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace nnet {
+
+  struct PatchGeometry {
+    PatchGeometry() = default; // no fiducial region, set for a plane before use
+
+    PatchGeometry(size_t nWires,
+                  size_t nScaledDrifts,
+                  size_t patchSizeW,
+                  size_t patchSizeD,
+                  float driftWindow)
+      : fDriftWindow(driftWindow), fInvDriftWindow(1.0F / driftWindow)
+    {
+      size_t marginW = patchSizeW / 8; // patchSize/2 will make patch always completely filled
+      size_t marginD = patchSizeD / 8;
+
+      fWireMin = marginW;
+      fWireMax = (nWires > marginW) ? nWires - marginW : 0;
+      fDriftMin = marginD;
+      fDriftMax = (nScaledDrifts > marginD) ? nScaledDrifts - marginD : 0;
+    }
+
+    /// same as (size_t)(drift / driftWindow), but with multiplication by the reciprocal
+    size_t
+    scaledDrift(float drift) const
+    {
+      size_t sd = (size_t)(drift * fInvDriftWindow);
+      if ((sd + 1) * fDriftWindow <= drift) { ++sd; }
+      else if ((sd > 0) && (sd * fDriftWindow > drift)) {
+        --sd;
+      }
+      return sd;
+    }
+
+    bool
+    isInside(unsigned int wire, size_t scaledDrift) const
+    {
+      return (wire >= fWireMin) && (wire < fWireMax) && (scaledDrift >= fDriftMin) &&
+             (scaledDrift < fDriftMax);
+    }
+
+    /// fiducial mask and scaled drift coordinates for a batch of [wire, drift] points
+    void
+    scan(std::vector<std::pair<unsigned int, float>> const& points,
+         std::vector<char>& inside,
+         std::vector<size_t>& scaledDrifts) const
+    {
+      size_t n = points.size();
+      inside.resize(n);
+      scaledDrifts.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        scaledDrifts[i] = scaledDrift(points[i].second);
+      }
+      for (size_t i = 0; i < n; ++i) {
+        inside[i] = isInside(points[i].first, scaledDrifts[i]);
+      }
+    }
+
+    size_t fWireMin = 0, fWireMax = 0;   // fiducial wire index range [min, max)
+    size_t fDriftMin = 0, fDriftMax = 0; // fiducial scaled drift range [min, max)
+    float fDriftWindow = 1, fInvDriftWindow = 1;
+  };
+
+}
+
+#endif
@@ -90,8 +90,8 @@ nnet::KerasModelInterface::Run(std::vector<std::vector<float>> const& inp2d)
 
 nnet::TfModelInterface::TfModelInterface(const char* modelFileName)
 {
-  g = tf::Graph::create(nnet::ModelInterface::findFile(modelFileName).c_str(),
-                        {"cnn_output", "_netout"});
+  g = tf::Graph::get(nnet::ModelInterface::findFile(modelFileName).c_str(),
+                     {"cnn_output", "_netout"});
   if (!g) { throw art::Exception(art::errors::Unknown) << "TF model failed."; }
 
   mf::LogInfo("TfModelInterface") << "TF model loaded.";
@@ -239,14 +239,26 @@ nnet::PointIdAlg::predictIdVector(unsigned int wire, float drift) const
 std::vector<std::vector<float>>
 nnet::PointIdAlg::predictIdVectors(std::vector<std::pair<unsigned int, float>> points) const
 {
+  std::vector<char> inside;
+  return predictIdVectors(points, inside);
+}
+
+std::vector<std::vector<float>>
+nnet::PointIdAlg::predictIdVectors(std::vector<std::pair<unsigned int, float>> const& points,
+                                   std::vector<char>& inside) const
+{
+  inside.clear();
   if (points.empty() || !fNNet) { return std::vector<std::vector<float>>(); }
 
+  std::vector<size_t> scaledDrifts;
+  fPatchGeometry.scan(points, inside, scaledDrifts);
+
   std::vector<std::vector<std::vector<float>>> inps(
     points.size(), std::vector<std::vector<float>>(fPatchSizeW, std::vector<float>(fPatchSizeD)));
   for (size_t i = 0; i < points.size(); ++i) {
     unsigned int wire = points[i].first;
     float drift = points[i].second;
-    if (!bufferPatch(wire, drift, inps[i])) {
+    if (!bufferPatch(wire, drift, scaledDrifts[i], inps[i])) {
       throw cet::exception("PointIdAlg") << "Patch buffering failed" << std::endl;
     }
   }
@@ -255,6 +267,22 @@ nnet::PointIdAlg::predictIdVectors(std::vector<std::pair<unsigned int, float>> p
 }
 // ------------------------------------------------------
 
+bool
+nnet::PointIdAlg::setWireDriftData(const detinfo::DetectorClocksData& clock_data,
+                                   const detinfo::DetectorPropertiesData& det_prop,
+                                   const std::vector<recob::Wire>& wires,
+                                   unsigned int plane,
+                                   unsigned int tpc,
+                                   unsigned int cryo)
+{
+  bool result =
+    img::DataProviderAlg::setWireDriftData(clock_data, det_prop, wires, plane, tpc, cryo);
+  fPatchGeometry = PatchGeometry(
+    fAlgView.fNWires, fAlgView.fNScaledDrifts, fPatchSizeW, fPatchSizeD, fDriftWindow);
+  return result;
+}
+// ------------------------------------------------------
+
 bool
 nnet::PointIdAlg::isSamePatch(unsigned int wire1,
                               float drift1,
@@ -315,15 +343,18 @@ nnet::PointIdAlg::flattenData2D(std::vector<std::vector<float>> const& patch)
 bool
 nnet::PointIdAlg::isInsideFiducialRegion(unsigned int wire, float drift) const
 {
-  size_t marginW = fPatchSizeW / 8; // fPatchSizeX/2 will make patch always completely filled
-  size_t marginD = fPatchSizeD / 8;
+  return fPatchGeometry.isInside(wire, fPatchGeometry.scaledDrift(drift));
+}
+// ------------------------------------------------------
 
-  size_t scaledDrift = (size_t)(drift / fDriftWindow);
-  if ((wire >= marginW) && (wire < fAlgView.fNWires - marginW) && (scaledDrift >= marginD) &&
-      (scaledDrift < fAlgView.fNScaledDrifts - marginD))
-    return true;
-  else
-    return false;
+std::vector<char>
+nnet::PointIdAlg::areInsideFiducialRegion(
+  std::vector<std::pair<unsigned int, float>> const& points) const
+{
+  std::vector<char> inside;
+  std::vector<size_t> scaledDrifts;
+  fPatchGeometry.scan(points, inside, scaledDrifts);
+  return inside;
 }
 // ------------------------------------------------------
 
@@ -26,6 +26,7 @@
 #include "lardataobj/RecoBase/Track.h"
 #include "larreco/RecoAlg/ImagePatternAlgs/DataProvider/DataProviderAlg.h"
 #include "larrecodnn/ImagePatternAlgs/Keras/keras_model.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/PatchGeometry.h"
 #include "larrecodnn/ImagePatternAlgs/Tensorflow/TF/tf_graph.h"
 #include "nusimdata/SimulationBase/MCParticle.h"
 namespace detinfo {
@@ -81,7 +82,7 @@ public:
   std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) override;
 
 private:
-  std::unique_ptr<tf::Graph> g; // network graph
+  std::shared_ptr<tf::Graph> g; // network graph, shared with other users of the model
 };
 // ------------------------------------------------------
 
@@ -123,6 +124,11 @@ public:
   std::vector<std::vector<float>> predictIdVectors(
     std::vector<std::pair<unsigned int, float>> points) const;
 
+  /// as above, and the fiducial mask of the points found on the way
+  std::vector<std::vector<float>> predictIdVectors(
+    std::vector<std::pair<unsigned int, float>> const& points,
+    std::vector<char>& inside) const;
+
   static std::vector<float> flattenData2D(std::vector<std::vector<float>> const& patch);
 
   std::vector<std::vector<float>> const&
@@ -136,8 +142,28 @@ public:
     return flattenData2D(fWireDriftPatch);
   } // flat vector made of the patch data, wire after wire
 
+  /// set up the plane image for the following points, with fiducial bounds and drift scaling
+  /// of the plane calculated once
+  bool setWireDriftData(const detinfo::DetectorClocksData& clock_data,
+                        const detinfo::DetectorPropertiesData& det_prop,
+                        const std::vector<recob::Wire>& wires,
+                        unsigned int plane,
+                        unsigned int tpc,
+                        unsigned int cryo);
+
+  /// fiducial bounds and drift scaling of the current plane (set with setWireDriftData)
+  PatchGeometry const&
+  patchGeometry() const
+  {
+    return fPatchGeometry;
+  }
+
   bool isInsideFiducialRegion(unsigned int wire, float drift) const;
 
+  /// fiducial mask for a batch of [wire, drift] points, bounds calculated once for all points
+  std::vector<char> areInsideFiducialRegion(
+    std::vector<std::pair<unsigned int, float>> const& points) const;
+
   /// test if wire/drift coordinates point to the current patch (so maybe the cnn output
   /// does not need to be recalculated)
   bool isCurrentPatch(unsigned int wire, float drift) const;
@@ -154,11 +180,18 @@ private:
   size_t fPatchSizeW, fPatchSizeD;
 
   mutable size_t fCurrentWireIdx, fCurrentScaledDrift;
+  PatchGeometry fPatchGeometry; // of the current plane
   bool
   bufferPatch(size_t wire, float drift, std::vector<std::vector<float>>& patch) const
+  {
+    size_t sd = fDownscaleFullView ? (size_t)(drift / fDriftWindow) : 0;
+    return bufferPatch(wire, drift, sd, patch);
+  }
+  /// sd is the scaled drift, drift / fDriftWindow, used if fDownscaleFullView is set
+  bool
+  bufferPatch(size_t wire, float drift, size_t sd, std::vector<std::vector<float>>& patch) const
   {
     if (fDownscaleFullView) {
-      size_t sd = (size_t)(drift / fDriftWindow);
       if ((fCurrentWireIdx == wire) && (fCurrentScaledDrift == sd))
         return true; // still within the current position
 
@@ -17,10 +17,15 @@
 #define IPointIdAlg_H
 
 #include "fhiclcpp/types/OptionalAtom.h"
+#include "fhiclcpp/types/OptionalDelegatedParameter.h"
 #include "fhiclcpp/types/OptionalSequence.h"
+#include "fhiclcpp/types/Sequence.h"
 #include "larreco/RecoAlg/ImagePatternAlgs/DataProvider/DataProviderAlg.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/PatchGeometry.h"
 #include "messagefacility/MessageLogger/MessageLogger.h"
 
+#include <array>
+
 namespace PointIdAlgTools {
   class IPointIdAlg : virtual public img::DataProviderAlg {
   public:
@@ -40,6 +45,95 @@ namespace PointIdAlgTools {
                                            Comment("How many downsampled ADC entries in patch")};
       fhicl::OptionalAtom<std::string> ToolType{Name("tool_type"),
                                                 Comment("PointID algorithm tool type")};
+      fhicl::Atom<int> KerasSparseConvLayers{
+        Name("KerasSparseConvLayers"),
+        Comment("Keras: number of the first conv layers skipping empty regions of patches"),
+        1};
+      fhicl::Atom<std::string> KerasParallelism{
+        Name("KerasParallelism"),
+        Comment("Keras: serial, intra (loops inside layers) or batch (samples in parallel)"),
+        "intra"};
+      fhicl::Atom<unsigned int> KerasGrainSize{
+        Name("KerasGrainSize"),
+        Comment("Keras: minimum number of kernels/tiles/samples per parallel task"),
+        1};
+      fhicl::Atom<int> KerasArenaThreads{
+        Name("KerasArenaThreads"),
+        Comment("Keras: threads of a dedicated TBB task arena, 0: use the shared one"),
+        0};
+      fhicl::Atom<bool> KerasProfiling{
+        Name("KerasProfiling"),
+        Comment("Keras: print time, FLOPs and memory traffic of each layer at the end of job"),
+        false};
+      fhicl::Atom<bool> TfXlaJit{
+        Name("TfXlaJit"),
+        Comment("TF: compile the graph with XLA JIT (ignored if TF is built without XLA)"),
+        false};
+      fhicl::Atom<bool> TfOptimizeGraph{
+        Name("TfOptimizeGraph"),
+        Comment("TF: prune graph to the outputs, fold constants and fuse ops at load time "
+                "(outputs may change at the rounding level)"),
+        false};
+      fhicl::Atom<bool> TfCacheGraph{
+        Name("TfCacheGraph"),
+        Comment("TF: keep the optimized graph next to the model file for the next jobs"),
+        false};
+      fhicl::Atom<int> OnnxIntraOpThreads{Name("OnnxIntraOpThreads"),
+                                          Comment("ONNX Runtime: threads used within ops"),
+                                          1};
+      fhicl::Atom<int> OnnxInterOpThreads{Name("OnnxInterOpThreads"),
+                                          Comment("ONNX Runtime: threads used across ops"),
+                                          1};
+      fhicl::Atom<std::string> OnnxOptimization{
+        Name("OnnxOptimization"),
+        Comment("ONNX Runtime graph optimizations: disable, basic, extended or all"),
+        "all"};
+      fhicl::Atom<bool> OnnxIoBinding{
+        Name("OnnxIoBinding"),
+        Comment("ONNX Runtime: bind the input in place and the outputs to per-thread buffers "
+                "reused between calls (needs ONNX Runtime 1.5 or newer)"),
+        false};
+      fhicl::OptionalDelegatedParameter Models{
+        Name("Models"),
+        Comment("PointIdAlgMulti, PointIdAlgCascade, PointIdAlgHybrid, PointIdAlgCached: "
+                "models applied to the same patches, each a table with NNetModelFile, "
+                "NNetOutputs and optionally other parameters of this table; parameters not "
+                "given are taken from this table")};
+      fhicl::Sequence<float, 2> CascadeBand{
+        Name("CascadeBand"),
+        Comment("PointIdAlgCascade: points with the fast model score in [min, max] are "
+                "passed to the heavy model"),
+        std::array<float, 2>{{0.1F, 0.9F}}};
+      fhicl::Atom<int> CascadeOutput{
+        Name("CascadeOutput"),
+        Comment("PointIdAlgCascade: index of the fast model output used as the score, "
+                "-1: the highest output"),
+        -1};
+      fhicl::Atom<unsigned int> HybridMinRemoteBatch{
+        Name("HybridMinRemoteBatch"),
+        Comment("PointIdAlgHybrid: smaller batches are run with the local model"),
+        64};
+      fhicl::Atom<float> HybridMaxRemoteLatency{
+        Name("HybridMaxRemoteLatency"),
+        Comment("PointIdAlgHybrid: if the average remote time per sample [ms] is above, all "
+                "batches are run locally except probes of the server; 0: no limit"),
+        0.0F};
+      fhicl::Atom<unsigned int> HybridProbeInterval{
+        Name("HybridProbeInterval"),
+        Comment("PointIdAlgHybrid: while the server is slow or failing, every n-th large "
+                "batch is still sent to check its latency"),
+        20};
+      fhicl::OptionalAtom<std::string> CacheFile{
+        Name("CacheFile"),
+        Comment("PointIdAlgCached: file keeping the model outputs for patches already seen, "
+                "the model key is appended to the name")};
+      fhicl::OptionalAtom<std::string> SchedulerModel{
+        Name("SchedulerModel"),
+        Comment("PointIdAlgScheduled: name of the model in the InferenceScheduler service")};
+      fhicl::Atom<int> SchedulerPriority{
+        Name("SchedulerPriority"),
+        Comment("PointIdAlgScheduled: requests with higher priority are run first"),
+        0};
       fhicl::OptionalAtom<std::string> TrtisModelName{
         Name("TrtisModelName"),
         Comment("Model directory name in repository of TensorRT inference server")};
@@ -103,15 +197,28 @@ namespace PointIdAlgTools {
     std::vector<std::vector<float>>
     predictIdVectors(const std::vector<std::pair<unsigned int, float>>& points)
     {
+      std::vector<char> inside;
+      return predictIdVectors(points, inside);
+    }
+
+    // As above, and the fiducial mask of the points found on the way
+    std::vector<std::vector<float>>
+    predictIdVectors(const std::vector<std::pair<unsigned int, float>>& points,
+                     std::vector<char>& inside)
+    {
+      inside.clear();
       if (points.empty()) { return std::vector<std::vector<float>>(); }
 
+      std::vector<size_t> scaledDrifts;
+      fPatchGeometry.scan(points, inside, scaledDrifts);
+
       std::vector<std::vector<std::vector<float>>> inps(
         points.size(),
         std::vector<std::vector<float>>(fPatchSizeW, std::vector<float>(fPatchSizeD)));
       for (size_t i = 0; i < points.size(); ++i) {
         unsigned int wire = points[i].first;
         float drift = points[i].second;
-        if (!bufferPatch(wire, drift, inps[i])) {
+        if (!bufferPatch(wire, drift, scaledDrifts[i], inps[i])) {
           throw cet::exception("PointIdAlg") << "Patch buffering failed" << std::endl;
         }
       }
@@ -124,33 +231,74 @@ namespace PointIdAlgTools {
     {
       return fNNetOutputs;
     }
+    // Number of outputs of each model, concatenated in the results of Run; a single model
+    // unless the tool runs several models on the same patches (PointIdAlgMulti)
+    std::vector<size_t>
+    modelOutputSizes(void) const
+    {
+      if (fModelOutputSizes.empty()) { return std::vector<size_t>(1, fNNetOutputs.size()); }
+      return fModelOutputSizes;
+    }
+    // Set up the plane image for the following points; fiducial bounds and drift scaling of
+    // the plane are calculated here, once per plane
+    bool
+    setWireDriftData(const detinfo::DetectorClocksData& clock_data,
+                     const detinfo::DetectorPropertiesData& det_prop,
+                     const std::vector<recob::Wire>& wires,
+                     unsigned int plane,
+                     unsigned int tpc,
+                     unsigned int cryo)
+    {
+      bool result =
+        img::DataProviderAlg::setWireDriftData(clock_data, det_prop, wires, plane, tpc, cryo);
+      fPatchGeometry = nnet::PatchGeometry(
+        fAlgView.fNWires, fAlgView.fNScaledDrifts, fPatchSizeW, fPatchSizeD, fDriftWindow);
+      return result;
+    }
+
+    // Fiducial bounds and drift scaling of the current plane (set with setWireDriftData)
+    nnet::PatchGeometry const&
+    patchGeometry() const
+    {
+      return fPatchGeometry;
+    }
+
     bool
     isInsideFiducialRegion(unsigned int wire, float drift) const
     {
-      size_t marginW = fPatchSizeW / 8; // fPatchSizeX/2 will make patch always completely filled
-      size_t marginD = fPatchSizeD / 8;
+      return fPatchGeometry.isInside(wire, fPatchGeometry.scaledDrift(drift));
+    }
 
-      size_t scaledDrift = (size_t)(drift / fDriftWindow);
-      if ((wire >= marginW) && (wire < fAlgView.fNWires - marginW) && (scaledDrift >= marginD) &&
-          (scaledDrift < fAlgView.fNScaledDrifts - marginD)) {
-        return true;
-      }
-      else {
-        return false;
-      }
+    // Fiducial mask for a batch of [wire, drift] points
+    std::vector<char>
+    areInsideFiducialRegion(const std::vector<std::pair<unsigned int, float>>& points) const
+    {
+      std::vector<char> inside;
+      std::vector<size_t> scaledDrifts;
+      fPatchGeometry.scan(points, inside, scaledDrifts);
+      return inside;
     }
 
   protected:
     std::vector<std::string> fNNetOutputs;
+    std::vector<size_t> fModelOutputSizes; // set only by tools running several models
     size_t fPatchSizeW, fPatchSizeD;
     std::vector<std::vector<float>> fWireDriftPatch; // patch data around the identified point
     size_t fCurrentWireIdx, fCurrentScaledDrift;
+    nnet::PatchGeometry fPatchGeometry; // of the current plane
 
     bool
     bufferPatch(size_t wire, float drift, std::vector<std::vector<float>>& patch)
+    {
+      size_t sd = fDownscaleFullView ? (size_t)(drift / fDriftWindow) : 0;
+      return bufferPatch(wire, drift, sd, patch);
+    }
+
+    // sd is the scaled drift, drift / fDriftWindow, used if fDownscaleFullView is set
+    bool
+    bufferPatch(size_t wire, float drift, size_t sd, std::vector<std::vector<float>>& patch)
     {
       if (fDownscaleFullView) {
-        size_t sd = (size_t)(drift / fDriftWindow);
         if ((fCurrentWireIdx == wire) && (fCurrentScaledDrift == sd))
           return true; // still within the current position
 
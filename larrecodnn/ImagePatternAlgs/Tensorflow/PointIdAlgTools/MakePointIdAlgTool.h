@@ -0,0 +1,76 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function:    makePointIdAlgTool
+//
+// Creates the IPointIdAlg tool for a PointIdAlg configuration. Configurations written for
+// nnet::PointIdAlg have no tool_type, the tool is then selected from the model file extension
+// (.pb: TF, .so: Keras model compiled with nnet_to_cpp.py, .onnx: ONNX Runtime, otherwise: Keras).
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef MakePointIdAlgTool_H
+#define MakePointIdAlgTool_H
+
+#include "art/Utilities/make_tool.h"
+#include "canvas/Utilities/Exception.h"
+#include "fhiclcpp/ParameterSet.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace PointIdAlgTools {
+
+  inline std::unique_ptr<IPointIdAlg>
+  makePointIdAlgTool(fhicl::ParameterSet pset)
+  {
+    if (!pset.has_key("tool_type")) {
+      auto const model = pset.get<std::string>("NNetModelFile", "");
+      auto const endsWith = [&model](std::string const& ext) {
+        return (model.length() > ext.length()) &&
+               (model.compare(model.length() - ext.length(), ext.length(), ext) == 0);
+      };
+      std::string toolType = "PointIdAlgKeras";
+      if (endsWith(".pb")) { toolType = "PointIdAlgTf"; }
+      else if (endsWith(".so")) {
+        toolType = "PointIdAlgAot";
+      }
+      else if (endsWith(".onnx")) {
+        toolType = "PointIdAlgOnnx";
+      }
+      pset.put("tool_type", toolType);
+    }
+    return art::make_tool<IPointIdAlg>(pset);
+  }
+
+  // Tools for the models of a tool combining several models (table Models in the configuration
+  // main); parameters not given for a model are taken from main, patch size has to be the same.
+  inline std::vector<std::unique_ptr<IPointIdAlg>>
+  makeModelTools(fhicl::ParameterSet main, std::vector<fhicl::ParameterSet> const& models)
+  {
+    auto const tool = main.get<std::string>("tool_type", "PointIdAlg");
+    auto const patchW = main.get<unsigned int>("PatchSizeW");
+    auto const patchD = main.get<unsigned int>("PatchSizeD");
+    main.erase("Models");
+    main.erase("tool_type");
+
+    std::vector<std::unique_ptr<IPointIdAlg>> result;
+    for (auto const& model : models) {
+      if (model.has_key("Models")) {
+        throw art::Exception(art::errors::Configuration) << tool << ": nested Models.";
+      }
+      // model parameters override the common ones
+      auto const pset = fhicl::ParameterSet::make(main.to_string() + " " + model.to_string());
+      if ((pset.get<unsigned int>("PatchSizeW") != patchW) ||
+          (pset.get<unsigned int>("PatchSizeD") != patchD)) {
+        throw art::Exception(art::errors::Configuration)
+          << tool << ": all models need the patch size " << patchW << "x" << patchD << ".";
+      }
+      result.push_back(makePointIdAlgTool(pset));
+    }
+    return result;
+  }
+
+}
+
+#endif
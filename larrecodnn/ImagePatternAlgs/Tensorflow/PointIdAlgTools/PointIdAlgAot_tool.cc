@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PointIdAlgAot_tool
+//
+// Runs Keras models compiled ahead of time: C++ source generated from the .nnet file with
+// Keras/nnet_to_cpp.py and built into a plugin library, which is loaded with dlopen. Input
+// image shape is fixed in the plugin, it has to match PatchSizeW x PatchSizeD.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "art/Utilities/ToolMacros.h"
+
+#include "larrecodnn/ImagePatternAlgs/Keras/keras_aot.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+namespace PointIdAlgTools {
+
+  class PointIdAlgAot : public IPointIdAlg {
+  public:
+    explicit PointIdAlgAot(fhicl::Table<Config> const& table);
+    ~PointIdAlgAot() noexcept;
+
+    std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
+    std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                                        int samples = -1) const override;
+
+  private:
+    std::string findFile(const char* fileName) const;
+    void run(std::vector<std::vector<float>> const& inp2d, std::vector<float>& out) const;
+
+    void* fLib; // plugin library handle
+    keras_aot_info const* fInfo;
+    keras_aot_compute_fn fCompute;
+    std::string fNNetModelFilePath;
+  };
+
+  // ------------------------------------------------------
+  PointIdAlgAot::PointIdAlgAot(fhicl::Table<Config> const& table)
+    : img::DataProviderAlg(table()), fLib(nullptr), fInfo(nullptr), fCompute(nullptr)
+  {
+    // ... Get common config vars
+    fNNetOutputs = table().NNetOutputs();
+    fPatchSizeW = table().PatchSizeW();
+    fPatchSizeD = table().PatchSizeD();
+    fCurrentWireIdx = 99999;
+    fCurrentScaledDrift = 99999;
+
+    std::string s_cfgvr;
+    if (table().NNetModelFile(s_cfgvr)) { fNNetModelFilePath = s_cfgvr; }
+    else {
+      throw art::Exception(art::errors::Configuration) << "Model plugin library not specified.";
+    }
+
+    auto const libPath = findFile(fNNetModelFilePath.c_str());
+    fLib = dlopen(libPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!fLib) {
+      throw art::Exception(art::errors::Configuration)
+        << "Could not load model plugin " << libPath << ": " << dlerror();
+    }
+    auto info = reinterpret_cast<keras_aot_info_fn>(dlsym(fLib, "keras_aot_model_info"));
+    fCompute = reinterpret_cast<keras_aot_compute_fn>(dlsym(fLib, "keras_aot_compute"));
+    if (!info || !fCompute) {
+      dlclose(fLib);
+      throw art::Exception(art::errors::Configuration)
+        << "Library " << libPath << " is not a model plugin made with nnet_to_cpp.py.";
+    }
+    fInfo = info();
+
+    if ((fInfo->in_depth != 1) || (fInfo->in_rows != (int)fPatchSizeW) ||
+        (fInfo->in_cols != (int)fPatchSizeD)) {
+      int depth = fInfo->in_depth, rows = fInfo->in_rows, cols = fInfo->in_cols;
+      dlclose(fLib);
+      throw art::Exception(art::errors::Configuration)
+        << "Model plugin input " << depth << "x" << rows << "x" << cols
+        << " does not match the patch size " << fPatchSizeW << "x" << fPatchSizeD << ".";
+    }
+    mf::LogInfo("PointIdAlgAot") << "Compiled Keras model " << fInfo->name << " loaded from "
+                                 << libPath << ".";
+
+    resizePatch();
+  }
+
+  // ------------------------------------------------------
+  PointIdAlgAot::~PointIdAlgAot() noexcept
+  {
+    if (fLib) { dlclose(fLib); }
+  }
+
+  // ------------------------------------------------------
+  std::string
+  PointIdAlgAot::findFile(const char* fileName) const
+  {
+    std::string fname_out;
+    cet::search_path sp("FW_SEARCH_PATH");
+    if (!sp.find_file(fileName, fname_out)) {
+      struct stat buffer;
+      if (stat(fileName, &buffer) == 0) { fname_out = fileName; }
+      else {
+        throw art::Exception(art::errors::NotFound) << "Could not find the model file " << fileName;
+      }
+    }
+    return fname_out;
+  }
+
+  // ------------------------------------------------------
+  void
+  PointIdAlgAot::run(std::vector<std::vector<float>> const& inp2d, std::vector<float>& out) const
+  {
+    std::vector<float> inp;
+    inp.reserve(fInfo->in_rows * fInfo->in_cols);
+    for (auto const& row : inp2d) {
+      inp.insert(inp.end(), row.begin(), row.end());
+    }
+    out.resize(fInfo->out_size);
+    fCompute(inp.data(), out.data());
+  }
+
+  // ------------------------------------------------------
+  std::vector<float>
+  PointIdAlgAot::Run(std::vector<std::vector<float>> const& inp2d) const
+  {
+    std::vector<float> out;
+    run(inp2d, out);
+    return out;
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  PointIdAlgAot::Run(std::vector<std::vector<std::vector<float>>> const& inps, int samples) const
+  {
+    if ((samples == 0) || inps.empty() || inps.front().empty() || inps.front().front().empty()) {
+      return std::vector<std::vector<float>>();
+    }
+
+    if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
+
+    std::vector<std::vector<float>> out(samples);
+    for (long long int s = 0; s < samples; ++s) {
+      run(inps[s], out[s]);
+    }
+    return out;
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(PointIdAlgTools::PointIdAlgAot)
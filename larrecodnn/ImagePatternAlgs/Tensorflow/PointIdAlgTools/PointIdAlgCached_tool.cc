@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PointIdAlgCached_tool
+//
+// Keeps outputs of a model in an on-disk cache, CacheFile.<model key>, keyed by the patch
+// content; patches already seen, e.g. when the same data is reprocessed with only downstream
+// changes, get the stored outputs and only the others are passed to the model:
+//
+//   tool_type:   PointIdAlgCached
+//   NNetOutputs: ["track", "em", "none"]
+//   CacheFile:   "emtrk_cache.bin"
+//   Models:      [ { NNetModelFile: "emtrk.pb" } ]
+//
+// Each model (file and configuration) gets its own cache file. The hit rate is printed at the
+// end of job.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "art/Utilities/ToolMacros.h"
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/OutputCache.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/MakePointIdAlgTool.h"
+
+namespace PointIdAlgTools {
+
+  class PointIdAlgCached : public IPointIdAlg {
+  public:
+    explicit PointIdAlgCached(fhicl::Table<Config> const& table);
+
+    std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
+    std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                                        int samples = -1) const override;
+
+  private:
+    std::unique_ptr<IPointIdAlg> fModel;
+    std::unique_ptr<nnet::OutputCache> fCache;
+  };
+
+  // ------------------------------------------------------
+  PointIdAlgCached::PointIdAlgCached(fhicl::Table<Config> const& table)
+    : img::DataProviderAlg(table())
+  {
+    fPatchSizeW = table().PatchSizeW();
+    fPatchSizeD = table().PatchSizeD();
+    fCurrentWireIdx = 99999;
+    fCurrentScaledDrift = 99999;
+
+    std::vector<fhicl::ParameterSet> models;
+    if (!table().Models.get_if_present(models) || (models.size() != 1)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgCached: Models should list one model.";
+    }
+    std::string cacheFile;
+    if (!table().CacheFile(cacheFile)) {
+      throw art::Exception(art::errors::Configuration) << "PointIdAlgCached: CacheFile not set.";
+    }
+
+    fModel = std::move(makeModelTools(table.get_PSet(), models).front());
+    fNNetOutputs = fModel->outputLabels();
+
+    // key of the model: its configuration and file, but not the cache file name
+    auto common = table.get_PSet();
+    common.erase("Models");
+    common.erase("CacheFile");
+    common.erase("tool_type");
+    auto const modelPset =
+      fhicl::ParameterSet::make(common.to_string() + " " + models.front().to_string());
+    fCache = std::make_unique<nnet::OutputCache>(cacheFile,
+                                                 nnet::OutputCache::modelKey(modelPset),
+                                                 "PointIdAlgCached",
+                                                 fNNetOutputs.size());
+
+    resizePatch();
+  }
+
+  // ------------------------------------------------------
+  std::vector<float>
+  PointIdAlgCached::Run(std::vector<std::vector<float>> const& inp2d) const
+  {
+    std::vector<float> out;
+    auto const key = fCache->key(inp2d);
+    if (!fCache->find(key, out)) {
+      out = fModel->Run(inp2d);
+      if (!out.empty()) { fCache->insert(key, out); }
+    }
+    return out;
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  PointIdAlgCached::Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                        int samples) const
+  {
+    if ((samples == 0) || inps.empty()) { return std::vector<std::vector<float>>(); }
+
+    if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
+
+    std::vector<std::vector<float>> out(samples);
+    std::vector<std::uint64_t> keys;
+    std::vector<size_t> missing;
+    for (int s = 0; s < samples; ++s) {
+      auto const key = fCache->key(inps[s]);
+      if (!fCache->find(key, out[s])) {
+        keys.push_back(key);
+        missing.push_back(s);
+      }
+    }
+    if (missing.empty()) { return out; }
+
+    std::vector<std::vector<float>> modelOut;
+    if (missing.size() == (size_t)samples) { modelOut = fModel->Run(inps, samples); }
+    else {
+      std::vector<std::vector<std::vector<float>>> missingInps;
+      missingInps.reserve(missing.size());
+      for (size_t s : missing) {
+        missingInps.push_back(inps[s]);
+      }
+      modelOut = fModel->Run(missingInps);
+    }
+    if (modelOut.size() != missing.size()) {
+      throw cet::exception("PointIdAlgCached") << "Model failed." << std::endl;
+    }
+    for (size_t i = 0; i < missing.size(); ++i) {
+      fCache->insert(keys[i], modelOut[i]);
+      out[missing[i]] = std::move(modelOut[i]);
+    }
+    return out;
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(PointIdAlgTools::PointIdAlgCached)
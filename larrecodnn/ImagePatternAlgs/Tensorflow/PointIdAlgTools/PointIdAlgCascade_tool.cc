@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PointIdAlgCascade_tool
+//
+// Two-stage inference: a small, fast model is applied to all patches and only the points with
+// an uncertain score, within CascadeBand, are passed to the heavy model; outputs of the heavy
+// model replace outputs of the fast one for these points. Models are given in Models, the fast
+// one first, both with the same outputs:
+//
+//   tool_type:     PointIdAlgCascade
+//   NNetOutputs:   []                 # labels are taken from the models
+//   CascadeBand:   [0.1, 0.9]
+//   CascadeOutput: -1                 # score: the highest output of the fast model
+//   Models: [ { NNetModelFile: "emtrk_small.onnx" NNetOutputs: ["track", "em", "none"] },
+//             { NNetModelFile: "emtrk.pb"         NNetOutputs: ["track", "em", "none"] } ]
+//
+// The fraction of points passed to the heavy model is printed at the end of job.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "art/Utilities/ToolMacros.h"
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/MakePointIdAlgTool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace PointIdAlgTools {
+
+  class PointIdAlgCascade : public IPointIdAlg {
+  public:
+    explicit PointIdAlgCascade(fhicl::Table<Config> const& table);
+    ~PointIdAlgCascade() noexcept;
+
+    std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
+    std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                                        int samples = -1) const override;
+
+  private:
+    bool isUncertain(std::vector<float> const& out) const;
+
+    std::unique_ptr<IPointIdAlg> fFast, fHeavy;
+    float fBandMin, fBandMax;
+    int fScoreIdx; // -1: highest output
+
+    mutable std::atomic<size_t> fNPoints{0}, fNForwarded{0};
+  };
+
+  // ------------------------------------------------------
+  PointIdAlgCascade::PointIdAlgCascade(fhicl::Table<Config> const& table)
+    : img::DataProviderAlg(table())
+    , fBandMin(table().CascadeBand()[0])
+    , fBandMax(table().CascadeBand()[1])
+    , fScoreIdx(table().CascadeOutput())
+  {
+    fPatchSizeW = table().PatchSizeW();
+    fPatchSizeD = table().PatchSizeD();
+    fCurrentWireIdx = 99999;
+    fCurrentScaledDrift = 99999;
+
+    std::vector<fhicl::ParameterSet> models;
+    if (!table().Models.get_if_present(models) || (models.size() != 2)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgCascade: Models should list the fast and the heavy model.";
+    }
+    auto tools = makeModelTools(table.get_PSet(), models);
+    fFast = std::move(tools[0]);
+    fHeavy = std::move(tools[1]);
+
+    fNNetOutputs = fHeavy->outputLabels();
+    if (fFast->outputLabels() != fNNetOutputs) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgCascade: fast and heavy models need the same outputs, in the same order.";
+    }
+    auto const& labels = table().NNetOutputs();
+    if (!labels.empty() && (labels != fNNetOutputs)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgCascade: NNetOutputs should be empty or match outputs of the Models.";
+    }
+    if ((fScoreIdx < -1) || (fScoreIdx >= (int)fNNetOutputs.size()) || (fBandMin > fBandMax)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgCascade: wrong CascadeOutput or CascadeBand.";
+    }
+    mf::LogInfo("PointIdAlgCascade") << "Points with the fast model score in [" << fBandMin
+                                     << ", " << fBandMax << "] passed to the heavy model.";
+
+    resizePatch();
+  }
+
+  // ------------------------------------------------------
+  PointIdAlgCascade::~PointIdAlgCascade() noexcept
+  {
+    size_t n = fNPoints, nf = fNForwarded;
+    if (n) {
+      mf::LogInfo("PointIdAlgCascade")
+        << "Points: " << n << ", passed to the heavy model: " << nf << " ("
+        << 100.0 * nf / n << "%).";
+    }
+  }
+
+  // ------------------------------------------------------
+  bool
+  PointIdAlgCascade::isUncertain(std::vector<float> const& out) const
+  {
+    if (out.empty()) { return true; }
+    float score = (fScoreIdx < 0) ? *std::max_element(out.begin(), out.end()) : out[fScoreIdx];
+    return (score >= fBandMin) && (score <= fBandMax);
+  }
+
+  // ------------------------------------------------------
+  std::vector<float>
+  PointIdAlgCascade::Run(std::vector<std::vector<float>> const& inp2d) const
+  {
+    ++fNPoints;
+    auto out = fFast->Run(inp2d);
+    if (isUncertain(out)) {
+      ++fNForwarded;
+      out = fHeavy->Run(inp2d);
+    }
+    return out;
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  PointIdAlgCascade::Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                         int samples) const
+  {
+    if ((samples == 0) || inps.empty()) { return std::vector<std::vector<float>>(); }
+
+    if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
+
+    auto out = fFast->Run(inps, samples);
+    if (out.size() != (size_t)samples) {
+      throw cet::exception("PointIdAlgCascade") << "Fast model failed." << std::endl;
+    }
+
+    std::vector<size_t> uncertain;
+    for (int s = 0; s < samples; ++s) {
+      if (isUncertain(out[s])) { uncertain.push_back(s); }
+    }
+    fNPoints += samples;
+    fNForwarded += uncertain.size();
+    if (uncertain.empty()) { return out; }
+
+    std::vector<std::vector<std::vector<float>>> heavyInps;
+    heavyInps.reserve(uncertain.size());
+    for (size_t s : uncertain) {
+      heavyInps.push_back(inps[s]);
+    }
+    auto heavyOut = fHeavy->Run(heavyInps);
+    if (heavyOut.size() != uncertain.size()) {
+      throw cet::exception("PointIdAlgCascade") << "Heavy model failed." << std::endl;
+    }
+    for (size_t i = 0; i < uncertain.size(); ++i) {
+      out[uncertain[i]] = std::move(heavyOut[i]);
+    }
+    return out;
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(PointIdAlgTools::PointIdAlgCascade)
@@ -0,0 +1,190 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PointIdAlgHybrid_tool
+//
+// Routes batches of patches between a local model and a remote one (e.g. PointIdAlgTrtis):
+// large batches go to the server, small ones (tails at the plane boundaries, single points) are
+// run locally. If the average remote time per sample is above HybridMaxRemoteLatency, or a
+// remote request fails, batches are run locally and only every HybridProbeInterval-th large
+// batch is sent to the server, until its latency is back below the limit. The latency is taken
+// per sample so the limit does not depend on the batch size. Both models should give the same
+// outputs, the local one is listed first:
+//
+//   tool_type:            PointIdAlgHybrid
+//   NNetOutputs:          ["track", "em", "none"]
+//   HybridMinRemoteBatch: 64
+//   HybridMaxRemoteLatency: 2                # [ms per sample]
+//   Models: [ { NNetModelFile: "emtrk.pb"  tool_type: "PointIdAlgTf" },
+//             { TrtisModelName: "emtrk"   TrtisURL: "localhost:8001"  tool_type: "PointIdAlgTrtis" } ]
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "art/Utilities/ToolMacros.h"
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/MakePointIdAlgTool.h"
+
+#include <chrono>
+#include <mutex>
+
+namespace PointIdAlgTools {
+
+  class PointIdAlgHybrid : public IPointIdAlg {
+  public:
+    explicit PointIdAlgHybrid(fhicl::Table<Config> const& table);
+    ~PointIdAlgHybrid() noexcept;
+
+    std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
+    std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                                        int samples = -1) const override;
+
+  private:
+    bool useRemote(size_t samples) const;
+    void remoteDone(double ms, size_t samples, bool ok) const;
+
+    std::unique_ptr<IPointIdAlg> fLocal, fRemote;
+    size_t fMinRemoteBatch;
+    double fMaxRemoteLatency; // [ms per sample], 0: no limit
+    size_t fProbeInterval;
+
+    mutable std::mutex fMutex;
+    mutable double fRemoteLatency = 0; // running average [ms per sample]
+    mutable bool fMeasured = false;
+    mutable bool fSlow = false;        // server slow or failing
+    mutable size_t fSkipped = 0;       // large batches run locally since the last probe
+    mutable size_t fNLocal = 0, fNRemote = 0, fNFailed = 0;
+  };
+
+  // ------------------------------------------------------
+  PointIdAlgHybrid::PointIdAlgHybrid(fhicl::Table<Config> const& table)
+    : img::DataProviderAlg(table())
+    , fMinRemoteBatch(table().HybridMinRemoteBatch())
+    , fMaxRemoteLatency(table().HybridMaxRemoteLatency())
+    , fProbeInterval(std::max(1U, table().HybridProbeInterval()))
+  {
+    fPatchSizeW = table().PatchSizeW();
+    fPatchSizeD = table().PatchSizeD();
+    fCurrentWireIdx = 99999;
+    fCurrentScaledDrift = 99999;
+
+    std::vector<fhicl::ParameterSet> models;
+    if (!table().Models.get_if_present(models) || (models.size() != 2)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgHybrid: Models should list the local and the remote model.";
+    }
+    auto tools = makeModelTools(table.get_PSet(), models);
+    fLocal = std::move(tools[0]);
+    fRemote = std::move(tools[1]);
+
+    fNNetOutputs = fLocal->outputLabels();
+    if (fRemote->outputLabels() != fNNetOutputs) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgHybrid: local and remote models need the same outputs, in the same order.";
+    }
+    auto const& labels = table().NNetOutputs();
+    if (!labels.empty() && (labels != fNNetOutputs)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgHybrid: NNetOutputs should be empty or match outputs of the Models.";
+    }
+
+    resizePatch();
+  }
+
+  // ------------------------------------------------------
+  PointIdAlgHybrid::~PointIdAlgHybrid() noexcept
+  {
+    if (fNLocal + fNRemote) {
+      mf::LogInfo("PointIdAlgHybrid")
+        << "Batches run locally: " << fNLocal << ", remotely: " << fNRemote
+        << ", remote failures: " << fNFailed << ", average remote latency: " << fRemoteLatency
+        << " ms per sample.";
+    }
+  }
+
+  // ------------------------------------------------------
+  bool
+  PointIdAlgHybrid::useRemote(size_t samples) const
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    bool remote = (samples >= fMinRemoteBatch);
+    if (remote && fSlow) {
+      if (++fSkipped < fProbeInterval) { remote = false; }
+      else {
+        fSkipped = 0; // probe the server
+      }
+    }
+    if (remote) { ++fNRemote; }
+    else {
+      ++fNLocal;
+    }
+    return remote;
+  }
+
+  // ------------------------------------------------------
+  void
+  PointIdAlgHybrid::remoteDone(double ms, size_t samples, bool ok) const
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (!ok) {
+      ++fNFailed;
+      fSlow = true;
+      return;
+    }
+    // recent batches count most, a probe after a slow period restores the estimate quickly
+    double const latency = ms / samples;
+    fRemoteLatency = (fMeasured && !fSlow) ? 0.8 * fRemoteLatency + 0.2 * latency : latency;
+    fMeasured = true;
+    bool const slow = (fMaxRemoteLatency > 0) && (fRemoteLatency > fMaxRemoteLatency);
+    if (slow != fSlow) {
+      mf::LogInfo("PointIdAlgHybrid")
+        << (slow ? "Remote latency " : "Remote latency back to ") << fRemoteLatency
+        << " ms per sample, "
+        << (slow ? "running batches locally." : "running large batches remotely.");
+    }
+    fSlow = slow;
+    fSkipped = 0;
+  }
+
+  // ------------------------------------------------------
+  std::vector<float>
+  PointIdAlgHybrid::Run(std::vector<std::vector<float>> const& inp2d) const
+  {
+    std::vector<std::vector<std::vector<float>>> inps(1, inp2d);
+    auto out = Run(inps, 1);
+    if (!out.empty()) { return out.front(); }
+    else {
+      return std::vector<float>();
+    }
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  PointIdAlgHybrid::Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                        int samples) const
+  {
+    if ((samples == 0) || inps.empty()) { return std::vector<std::vector<float>>(); }
+
+    if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
+
+    if (useRemote(samples)) {
+      auto const t0 = std::chrono::steady_clock::now();
+      std::vector<std::vector<float>> out;
+      bool ok = true;
+      try {
+        out = fRemote->Run(inps, samples);
+        ok = (out.size() == (size_t)samples);
+      }
+      catch (cet::exception const& e) {
+        mf::LogWarning("PointIdAlgHybrid") << "Remote model failed: " << e.what();
+        ok = false;
+      }
+      remoteDone(
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(),
+        samples,
+        ok);
+      if (ok) { return out; }
+    }
+    return fLocal->Run(inps, samples); // also if the server failed
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(PointIdAlgTools::PointIdAlgHybrid)
@@ -12,6 +12,7 @@
 #include "larrecodnn/ImagePatternAlgs/Keras/keras_model.h"
 #include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
 
+#include <sstream>
 #include <sys/stat.h>
 
 namespace PointIdAlgTools {
@@ -22,6 +23,7 @@ namespace PointIdAlgTools {
       : PointIdAlgKeras(fhicl::Table<Config>(pset, {})())
     {}
     explicit PointIdAlgKeras(const Config& config);
+    ~PointIdAlgKeras() noexcept;
 
     std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
     std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
@@ -31,6 +33,7 @@ namespace PointIdAlgTools {
     std::unique_ptr<keras::KerasModel> m;
     std::string fNNetModelFilePath;
     std::string findFile(const char* fileName) const;
+    static keras::KerasModel::Parallelism parallelism(std::string const& name);
   };
 
   // ------------------------------------------------------
@@ -52,8 +55,15 @@ namespace PointIdAlgTools {
 
     if ((fNNetModelFilePath.length() > 5) &&
         (fNNetModelFilePath.compare(fNNetModelFilePath.length() - 5, 5, ".nnet") == 0)) {
-      m = std::make_unique<keras::KerasModel>(findFile(fNNetModelFilePath.c_str()).c_str());
-      mf::LogInfo("PointIdAlgKeras") << "Keras model loaded.";
+      m = std::make_unique<keras::KerasModel>(findFile(fNNetModelFilePath.c_str()).c_str(),
+                                              8, // Winograd for 3x3 kernels of depth >= 8
+                                              config.KerasSparseConvLayers());
+      m->set_parallelism(parallelism(config.KerasParallelism()),
+                         config.KerasGrainSize(),
+                         config.KerasArenaThreads());
+      m->set_profiling(config.KerasProfiling());
+      mf::LogInfo("PointIdAlgKeras") << "Keras model loaded, parallelism "
+                                     << config.KerasParallelism() << ".";
     }
     else {
       mf::LogError("PointIdAlgKeras") << "File name extension not supported.";
@@ -62,6 +72,17 @@ namespace PointIdAlgTools {
     resizePatch();
   }
 
+  // ------------------------------------------------------
+  PointIdAlgKeras::~PointIdAlgKeras() noexcept
+  {
+    if (m && m->is_profiling()) {
+      std::ostringstream table;
+      m->print_profile(table);
+      mf::LogInfo("PointIdAlgKeras") << "Profile of " << fNNetModelFilePath << ":\n"
+                                     << table.str();
+    }
+  }
+
   // ------------------------------------------------------
   std::string
   PointIdAlgKeras::findFile(const char* fileName) const
@@ -78,6 +99,17 @@ namespace PointIdAlgTools {
     return fname_out;
   }
 
+  // ------------------------------------------------------
+  keras::KerasModel::Parallelism
+  PointIdAlgKeras::parallelism(std::string const& name)
+  {
+    if (name == "serial") { return keras::KerasModel::Parallelism::Serial; }
+    if (name == "intra") { return keras::KerasModel::Parallelism::IntraLayer; }
+    if (name == "batch") { return keras::KerasModel::Parallelism::Batch; }
+    throw art::Exception(art::errors::Configuration)
+      << "KerasParallelism " << name << " not supported, use serial, intra or batch.";
+  }
+
   // ------------------------------------------------------
   std::vector<float>
   PointIdAlgKeras::Run(std::vector<std::vector<float>> const& inp2d) const
@@ -101,19 +133,17 @@ namespace PointIdAlgTools {
 
     if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
 
-    std::vector<std::vector<float>> out;
-
+    std::vector<keras::DataChunk2D> chunks(samples);
+    std::vector<keras::DataChunk*> batch(samples);
     for (long long int s = 0; s < samples; ++s) {
       std::vector<std::vector<std::vector<float>>> inp3d;
       inp3d.push_back(inps[s]); // lots of copy, should add 2D to keras...
 
-      keras::DataChunk* sample = new keras::DataChunk2D();
-      sample->set_data(inp3d); // and more copy...
-      out.push_back(m->compute_output(sample));
-      delete sample;
+      chunks[s].set_data(inp3d); // and more copy...
+      batch[s] = &chunks[s];
     }
 
-    return out;
+    return m->compute_output(batch); // samples in parallel if KerasParallelism is batch
   }
 
 }
@@ -0,0 +1,114 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PointIdAlgMulti_tool
+//
+// Runs several models with the same patch geometry on the same points: plane images and patches
+// are prepared once by this tool and each batch of patches is passed to all models. Models are
+// listed in Models, e.g.:
+//
+//   tool_type:   PointIdAlgMulti
+//   NNetOutputs: []                 # labels are taken from the models
+//   Models: [ { NNetModelFile: "emtrk.pb"    NNetOutputs: ["track", "em", "none"] },
+//             { NNetModelFile: "michel.onnx" NNetOutputs: ["track", "em", "none", "michel"] } ]
+//
+// Parameters not given for a model (backend settings, tool_type...) are taken from the main
+// table. Outputs of the models are concatenated per point in the order of Models, see
+// modelOutputSizes() to split them.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "art/Utilities/ToolMacros.h"
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/MakePointIdAlgTool.h"
+
+namespace PointIdAlgTools {
+
+  class PointIdAlgMulti : public IPointIdAlg {
+  public:
+    explicit PointIdAlgMulti(fhicl::Table<Config> const& table);
+
+    std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
+    std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                                        int samples = -1) const override;
+
+  private:
+    std::vector<std::unique_ptr<IPointIdAlg>> fModels;
+  };
+
+  // ------------------------------------------------------
+  PointIdAlgMulti::PointIdAlgMulti(fhicl::Table<Config> const& table)
+    : img::DataProviderAlg(table())
+  {
+    fPatchSizeW = table().PatchSizeW();
+    fPatchSizeD = table().PatchSizeD();
+    fCurrentWireIdx = 99999;
+    fCurrentScaledDrift = 99999;
+
+    std::vector<fhicl::ParameterSet> models;
+    if (!table().Models.get_if_present(models) || models.empty()) {
+      throw art::Exception(art::errors::Configuration) << "PointIdAlgMulti: no Models.";
+    }
+
+    fModels = makeModelTools(table.get_PSet(), models);
+    for (auto const& model : fModels) {
+      auto const& labels = model->outputLabels();
+      fNNetOutputs.insert(fNNetOutputs.end(), labels.begin(), labels.end());
+      fModelOutputSizes.push_back(labels.size());
+    }
+
+    auto const& labels = table().NNetOutputs();
+    if (!labels.empty() && (labels != fNNetOutputs)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgMulti: NNetOutputs should be empty or match outputs of the Models.";
+    }
+    mf::LogInfo("PointIdAlgMulti") << fModels.size() << " models, " << fNNetOutputs.size()
+                                   << " outputs.";
+
+    resizePatch();
+  }
+
+  // ------------------------------------------------------
+  std::vector<float>
+  PointIdAlgMulti::Run(std::vector<std::vector<float>> const& inp2d) const
+  {
+    std::vector<float> result;
+    result.reserve(fNNetOutputs.size());
+    for (size_t m = 0; m < fModels.size(); ++m) {
+      auto const out = fModels[m]->Run(inp2d);
+      if (out.size() != fModelOutputSizes[m]) { return std::vector<float>(); }
+      result.insert(result.end(), out.begin(), out.end());
+    }
+    return result;
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  PointIdAlgMulti::Run(std::vector<std::vector<std::vector<float>>> const& inps, int samples) const
+  {
+    if ((samples == 0) || inps.empty()) { return std::vector<std::vector<float>>(); }
+
+    if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
+
+    std::vector<std::vector<float>> result(samples);
+    for (auto& r : result) {
+      r.reserve(fNNetOutputs.size());
+    }
+    for (size_t m = 0; m < fModels.size(); ++m) {
+      auto const out = fModels[m]->Run(inps, samples);
+      if (out.size() != (size_t)samples) {
+        throw cet::exception("PointIdAlgMulti") << "Model " << m << " failed." << std::endl;
+      }
+      for (int s = 0; s < samples; ++s) {
+        if (out[s].size() != fModelOutputSizes[m]) {
+          throw cet::exception("PointIdAlgMulti")
+            << "Model " << m << " returned " << out[s].size() << " outputs, expected "
+            << fModelOutputSizes[m] << "." << std::endl;
+        }
+        result[s].insert(result[s].end(), out[s].begin(), out[s].end());
+      }
+    }
+    return result;
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(PointIdAlgTools::PointIdAlgMulti)
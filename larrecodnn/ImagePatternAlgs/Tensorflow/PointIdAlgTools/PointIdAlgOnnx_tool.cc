@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PointIdAlgOnnx_tool
+//
+// Runs .onnx models (e.g. converted from Keras or TF with keras2onnx / tf2onnx) with the CPU
+// execution provider of ONNX Runtime. The model input is a batch of patches, PatchSizeW x
+// PatchSizeD each (NHWC with one channel, or NCHW, the memory layout is the same).
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "art/Utilities/ToolMacros.h"
+
+#include "larrecodnn/ImagePatternAlgs/ONNX/onnx_model.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+
+#include <sys/stat.h>
+
+namespace PointIdAlgTools {
+
+  class PointIdAlgOnnx : public IPointIdAlg {
+  public:
+    explicit PointIdAlgOnnx(fhicl::Table<Config> const& table);
+
+    std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
+    std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                                        int samples = -1) const override;
+
+  private:
+    std::string findFile(const char* fileName) const;
+
+    std::unique_ptr<ort::Model> m; // network model
+    std::vector<std::string> fNNetOutputPattern;
+    std::string fNNetModelFilePath;
+  };
+
+  // ------------------------------------------------------
+  PointIdAlgOnnx::PointIdAlgOnnx(fhicl::Table<Config> const& table) : img::DataProviderAlg(table())
+  {
+    // ... Get common config vars
+    fNNetOutputs = table().NNetOutputs();
+    fPatchSizeW = table().PatchSizeW();
+    fPatchSizeD = table().PatchSizeD();
+    fCurrentWireIdx = 99999;
+    fCurrentScaledDrift = 99999;
+
+    std::string s_cfgvr;
+    if (table().NNetModelFile(s_cfgvr)) { fNNetModelFilePath = s_cfgvr; }
+    else {
+      throw art::Exception(art::errors::Configuration) << "ONNX model file not specified.";
+    }
+    std::vector<std::string> vs_cfgvr;
+    if (table().NNetOutputPattern(vs_cfgvr)) { fNNetOutputPattern = vs_cfgvr; }
+
+    ort::ModelOptions options;
+    options.intra_op_threads = table().OnnxIntraOpThreads();
+    options.inter_op_threads = table().OnnxInterOpThreads();
+    options.optimization = table().OnnxOptimization();
+    options.io_binding = table().OnnxIoBinding();
+
+    m = ort::Model::create(findFile(fNNetModelFilePath.c_str()).c_str(), fNNetOutputPattern, options);
+    if (!m) { throw art::Exception(art::errors::Unknown) << "ONNX model failed."; }
+    if (m->input_size() != fPatchSizeW * fPatchSizeD) {
+      throw art::Exception(art::errors::Configuration)
+        << "ONNX model input size " << m->input_size() << " does not match the patch size "
+        << fPatchSizeW << "x" << fPatchSizeD << ".";
+    }
+    mf::LogInfo("PointIdAlgOnnx") << "ONNX model loaded.";
+
+    resizePatch();
+  }
+
+  // ------------------------------------------------------
+  std::string
+  PointIdAlgOnnx::findFile(const char* fileName) const
+  {
+    std::string fname_out;
+    cet::search_path sp("FW_SEARCH_PATH");
+    if (!sp.find_file(fileName, fname_out)) {
+      struct stat buffer;
+      if (stat(fileName, &buffer) == 0) { fname_out = fileName; }
+      else {
+        throw art::Exception(art::errors::NotFound) << "Could not find the model file " << fileName;
+      }
+    }
+    return fname_out;
+  }
+
+  // ------------------------------------------------------
+  std::vector<float>
+  PointIdAlgOnnx::Run(std::vector<std::vector<float>> const& inp2d) const
+  {
+    std::vector<float> inp;
+    inp.reserve(m->input_size());
+    for (auto const& row : inp2d) {
+      inp.insert(inp.end(), row.begin(), row.end());
+    }
+
+    auto out = m->run(inp, 1);
+    if (!out.empty())
+      return out.front();
+    else
+      return std::vector<float>();
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  PointIdAlgOnnx::Run(std::vector<std::vector<std::vector<float>>> const& inps, int samples) const
+  {
+    if ((samples == 0) || inps.empty() || inps.front().empty() || inps.front().front().empty()) {
+      return std::vector<std::vector<float>>();
+    }
+
+    if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
+
+    std::vector<float> inp;
+    inp.reserve(samples * m->input_size());
+    for (long long int s = 0; s < samples; ++s) {
+      for (auto const& row : inps[s]) {
+        inp.insert(inp.end(), row.begin(), row.end());
+      }
+    }
+    return m->run(inp, samples);
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(PointIdAlgTools::PointIdAlgOnnx)
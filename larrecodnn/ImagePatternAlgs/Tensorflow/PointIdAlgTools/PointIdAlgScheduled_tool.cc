@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PointIdAlgScheduled_tool
+//
+// Patches are prepared by this tool and passed to a model owned by the InferenceScheduler
+// service, SchedulerModel, batched there with requests of other modules and threads.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+#include "art/Utilities/ToolMacros.h"
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/Services/InferenceScheduler.h"
+
+namespace PointIdAlgTools {
+
+  class PointIdAlgScheduled : public IPointIdAlg {
+  public:
+    explicit PointIdAlgScheduled(fhicl::Table<Config> const& table);
+
+    std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
+    std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                                        int samples = -1) const override;
+
+  private:
+    nnet::InferenceScheduler* fScheduler;
+    std::string fModel;
+    int fPriority;
+  };
+
+  // ------------------------------------------------------
+  PointIdAlgScheduled::PointIdAlgScheduled(fhicl::Table<Config> const& table)
+    : img::DataProviderAlg(table())
+    , fScheduler(art::ServiceHandle<nnet::InferenceScheduler>().get())
+    , fPriority(table().SchedulerPriority())
+  {
+    fNNetOutputs = table().NNetOutputs();
+    fPatchSizeW = table().PatchSizeW();
+    fPatchSizeD = table().PatchSizeD();
+    fCurrentWireIdx = 99999;
+    fCurrentScaledDrift = 99999;
+
+    if (!table().SchedulerModel(fModel) || !fScheduler->hasModel(fModel)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgScheduled: SchedulerModel not defined in the InferenceScheduler.";
+    }
+    size_t const sampleSize = fScheduler->sampleSize(fModel);
+    if (sampleSize && (sampleSize != fPatchSizeW * fPatchSizeD)) {
+      throw art::Exception(art::errors::Configuration)
+        << "PointIdAlgScheduled: patch size of the model " << fModel << " is not " << fPatchSizeW
+        << "x" << fPatchSizeD << ".";
+    }
+
+    resizePatch();
+  }
+
+  // ------------------------------------------------------
+  std::vector<float>
+  PointIdAlgScheduled::Run(std::vector<std::vector<float>> const& inp2d) const
+  {
+    std::vector<std::vector<std::vector<float>>> inps(1, inp2d);
+    auto out = Run(inps, 1);
+    if (!out.empty()) { return out.front(); }
+    else {
+      return std::vector<float>();
+    }
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  PointIdAlgScheduled::Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                           int samples) const
+  {
+    if ((samples == 0) || inps.empty() || inps.front().empty() || inps.front().front().empty()) {
+      return std::vector<std::vector<float>>();
+    }
+
+    if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
+
+    nnet::InferenceScheduler::Samples x(samples);
+    for (long long int s = 0; s < samples; ++s) {
+      x[s].reserve(fPatchSizeW * fPatchSizeD);
+      for (auto const& row : inps[s]) {
+        x[s].insert(x[s].end(), row.begin(), row.end());
+      }
+    }
+    return fScheduler->run(fModel, std::move(x), fPriority);
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(PointIdAlgTools::PointIdAlgScheduled)
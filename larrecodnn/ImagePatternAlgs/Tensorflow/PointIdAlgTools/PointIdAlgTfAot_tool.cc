@@ -0,0 +1,155 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       PointIdAlgTfAot_tool
+//
+// Runs TF models compiled ahead of time with tfcompile for a fixed batch size, wrapped in a
+// plugin library made with TF/tf_aot_compile.py and loaded with dlopen. Input sample shape is
+// fixed in the plugin, it has to match PatchSizeW x PatchSizeD; patches are processed in batches
+// of the compiled size, the last one padded with zeros.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "art/Utilities/ToolMacros.h"
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/IPointIdAlg.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/TF/tf_aot.h"
+
+#include <algorithm>
+#include <dlfcn.h>
+#include <sys/stat.h>
+
+namespace PointIdAlgTools {
+
+  class PointIdAlgTfAot : public IPointIdAlg {
+  public:
+    explicit PointIdAlgTfAot(fhicl::Table<Config> const& table);
+    ~PointIdAlgTfAot() noexcept;
+
+    std::vector<float> Run(std::vector<std::vector<float>> const& inp2d) const override;
+    std::vector<std::vector<float>> Run(std::vector<std::vector<std::vector<float>>> const& inps,
+                                        int samples = -1) const override;
+
+  private:
+    std::string findFile(const char* fileName) const;
+
+    void* fLib; // plugin library handle
+    tf_aot_info const* fInfo;
+    tf_aot_compute_fn fCompute;
+    std::string fNNetModelFilePath;
+  };
+
+  // ------------------------------------------------------
+  PointIdAlgTfAot::PointIdAlgTfAot(fhicl::Table<Config> const& table)
+    : img::DataProviderAlg(table()), fLib(nullptr), fInfo(nullptr), fCompute(nullptr)
+  {
+    // ... Get common config vars
+    fNNetOutputs = table().NNetOutputs();
+    fPatchSizeW = table().PatchSizeW();
+    fPatchSizeD = table().PatchSizeD();
+    fCurrentWireIdx = 99999;
+    fCurrentScaledDrift = 99999;
+
+    std::string s_cfgvr;
+    if (table().NNetModelFile(s_cfgvr)) { fNNetModelFilePath = s_cfgvr; }
+    else {
+      throw art::Exception(art::errors::Configuration) << "Model plugin library not specified.";
+    }
+
+    auto const libPath = findFile(fNNetModelFilePath.c_str());
+    fLib = dlopen(libPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!fLib) {
+      throw art::Exception(art::errors::Configuration)
+        << "Could not load model plugin " << libPath << ": " << dlerror();
+    }
+    auto info = reinterpret_cast<tf_aot_info_fn>(dlsym(fLib, "tf_aot_model_info"));
+    fCompute = reinterpret_cast<tf_aot_compute_fn>(dlsym(fLib, "tf_aot_compute"));
+    if (!info || !fCompute) {
+      dlclose(fLib);
+      throw art::Exception(art::errors::Configuration)
+        << "Library " << libPath << " is not a model plugin made with tf_aot_compile.py.";
+    }
+    fInfo = info();
+
+    if ((fInfo->in_depth != 1) || (fInfo->in_rows != (int)fPatchSizeW) ||
+        (fInfo->in_cols != (int)fPatchSizeD) || (fInfo->batch < 1)) {
+      int rows = fInfo->in_rows, cols = fInfo->in_cols, depth = fInfo->in_depth;
+      dlclose(fLib);
+      throw art::Exception(art::errors::Configuration)
+        << "Model plugin input " << rows << "x" << cols << "x" << depth
+        << " does not match the patch size " << fPatchSizeW << "x" << fPatchSizeD << ".";
+    }
+    mf::LogInfo("PointIdAlgTfAot") << "Compiled TF model " << fInfo->name << " (batch "
+                                   << fInfo->batch << ") loaded from " << libPath << ".";
+
+    resizePatch();
+  }
+
+  // ------------------------------------------------------
+  PointIdAlgTfAot::~PointIdAlgTfAot() noexcept
+  {
+    if (fLib) { dlclose(fLib); }
+  }
+
+  // ------------------------------------------------------
+  std::string
+  PointIdAlgTfAot::findFile(const char* fileName) const
+  {
+    std::string fname_out;
+    cet::search_path sp("FW_SEARCH_PATH");
+    if (!sp.find_file(fileName, fname_out)) {
+      struct stat buffer;
+      if (stat(fileName, &buffer) == 0) { fname_out = fileName; }
+      else {
+        throw art::Exception(art::errors::NotFound) << "Could not find the model file " << fileName;
+      }
+    }
+    return fname_out;
+  }
+
+  // ------------------------------------------------------
+  std::vector<float>
+  PointIdAlgTfAot::Run(std::vector<std::vector<float>> const& inp2d) const
+  {
+    std::vector<std::vector<std::vector<float>>> inps(1, inp2d);
+    auto out = Run(inps, 1);
+    if (!out.empty()) { return out.front(); }
+    else {
+      return std::vector<float>();
+    }
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  PointIdAlgTfAot::Run(std::vector<std::vector<std::vector<float>>> const& inps, int samples) const
+  {
+    if ((samples == 0) || inps.empty() || inps.front().empty() || inps.front().front().empty()) {
+      return std::vector<std::vector<float>>();
+    }
+
+    if ((samples == -1) || (samples > (long long int)inps.size())) { samples = inps.size(); }
+
+    const size_t batch = fInfo->batch, sampleSize = fInfo->in_rows * fInfo->in_cols;
+    const size_t outSize = fInfo->out_size;
+    std::vector<float> inp(batch * sampleSize), res(batch * outSize);
+
+    std::vector<std::vector<float>> out(samples);
+    for (size_t s0 = 0; s0 < (size_t)samples; s0 += batch) {
+      size_t n = std::min(batch, samples - s0);
+      std::fill(inp.begin(), inp.end(), 0.0F); // padding of the last batch
+      for (size_t s = 0; s < n; ++s) {
+        float* dst = inp.data() + s * sampleSize;
+        for (auto const& row : inps[s0 + s]) {
+          dst = std::copy(row.begin(), row.end(), dst);
+        }
+      }
+      if (fCompute(inp.data(), res.data()) != 0) {
+        throw cet::exception("PointIdAlgTfAot") << "Compiled model " << fInfo->name << " failed.";
+      }
+      for (size_t s = 0; s < n; ++s) {
+        out[s0 + s].assign(res.begin() + s * outSize, res.begin() + (s + 1) * outSize);
+      }
+    }
+    return out;
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(PointIdAlgTools::PointIdAlgTfAot)
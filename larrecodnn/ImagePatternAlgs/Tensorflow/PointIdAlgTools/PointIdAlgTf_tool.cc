@@ -29,7 +29,7 @@ namespace PointIdAlgTools {
     std::string findFile(const char* fileName) const;
 
   private:
-    std::unique_ptr<tf::Graph> g; // network graph
+    std::shared_ptr<tf::Graph> g; // network graph, shared with other users of the model
     std::vector<std::string> fNNetOutputPattern;
     std::string fNNetModelFilePath;
   };
@@ -58,7 +58,12 @@ namespace PointIdAlgTools {
 
     if ((fNNetModelFilePath.length() > 3) &&
         (fNNetModelFilePath.compare(fNNetModelFilePath.length() - 3, 3, ".pb") == 0)) {
-      g = tf::Graph::create(findFile(fNNetModelFilePath.c_str()).c_str(), fNNetOutputPattern);
+      tf::GraphOptions options;
+      options.xla_jit = table().TfXlaJit();
+      options.optimize = table().TfOptimizeGraph();
+      options.cache = table().TfCacheGraph();
+      g = tf::Graph::get(
+        findFile(fNNetModelFilePath.c_str()).c_str(), fNNetOutputPattern, options);
       if (!g) { throw art::Exception(art::errors::Unknown) << "TF model failed."; }
       mf::LogInfo("PointIdAlgTf") << "TF model loaded.";
     }
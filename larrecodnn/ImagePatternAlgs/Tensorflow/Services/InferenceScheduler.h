@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       InferenceScheduler (art service)
+//
+// Owns local instances of models (IPointIdAlg or IWaveformRecog tools) and a pool of worker
+// threads running them. Tools and modules submit requests, each a batch of samples, without
+// waiting for the result; requests for the same model are coalesced into larger batches, up to
+// MaxBatchSize samples: requests queued while the workers are busy, and those coming within
+// MaxLatency. The waiting stops as soon as all Callers are blocked in run(), since no more
+// requests can come then. Requests with a higher priority are served first. Configuration:
+//
+//   services.InferenceScheduler: {
+//     Workers:      2      # threads running the models
+//     MaxBatchSize: 1024   # samples in one batch, a single larger request is not split
+//     MaxLatency:   0      # [ms] max. waiting time for more requests, 0: no waiting
+//     Callers:      4      # threads submitting requests, default: art threads
+//     Models: [ { Name: "emtrk" Type: "PointIdAlg" Tool: @local::emtrk_pointidalg } ]
+//   }
+//
+// Type is PointIdAlg (samples: patches flattened row by row) or WaveformRecog (samples: windows).
+// Use the PointIdAlgScheduled and WaveformRecogScheduled tools to run models through the service.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef InferenceScheduler_H
+#define InferenceScheduler_H
+
+#include "art/Framework/Services/Registry/ServiceMacros.h"
+#include "fhiclcpp/ParameterSet.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace art {
+  class ActivityRegistry;
+}
+
+namespace nnet {
+
+  class InferenceScheduler {
+  public:
+    using Samples = std::vector<std::vector<float>>; // flat input samples, or outputs per sample
+
+    InferenceScheduler(fhicl::ParameterSet const& pset, art::ActivityRegistry& reg);
+    ~InferenceScheduler();
+
+    bool
+    hasModel(std::string const& model) const
+    {
+      return fModels.count(model);
+    }
+
+    // Size of the input sample of the model, 0 if not fixed
+    size_t sampleSize(std::string const& model) const;
+
+    // Queue samples for the model, the outputs of each sample are returned with the future
+    std::future<Samples> submit(std::string const& model, Samples samples, int priority = 0);
+
+    // Queue samples and wait for the outputs
+    Samples
+    run(std::string const& model, Samples samples, int priority = 0)
+    {
+      return enqueue(model, std::move(samples), priority, true).get();
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+      Samples samples;
+      int priority;
+      size_t seq; // order of submission
+      Clock::time_point arrival;
+      bool blocking; // caller waits in run()
+      std::promise<Samples> result;
+    };
+
+    struct Model {
+      std::function<Samples(Samples const&)> run;
+      std::shared_ptr<void> tool; // keeps the tool used by run
+      size_t sampleSize = 0;
+
+      std::vector<std::unique_ptr<Request>> queue; // heap, highest priority on top
+      size_t queued = 0;                           // samples in the queue
+      size_t nBatches = 0, nRequests = 0, nSamples = 0;
+    };
+
+    std::future<Samples> enqueue(std::string const& model,
+                                 Samples samples,
+                                 int priority,
+                                 bool blocking);
+    bool allCallersBlocked() const; // no more requests can come
+    void worker();
+    Model* select(); // model with the most urgent request, or nullptr
+    void endJob();
+
+    std::map<std::string, Model> fModels;
+    size_t fMaxBatchSize;
+    Clock::duration fMaxLatency;
+    size_t fCallers; // 0: not known
+
+    std::mutex fMutex;
+    std::condition_variable fCond;
+    size_t fPending = 0, fSeq = 0;
+    size_t fBlocked = 0; // callers waiting in run(), for queued or running requests
+    bool fStop = false;
+    std::vector<std::thread> fWorkers;
+  };
+
+}
+
+DECLARE_ART_SERVICE(nnet::InferenceScheduler, SHARED)
+
+#endif
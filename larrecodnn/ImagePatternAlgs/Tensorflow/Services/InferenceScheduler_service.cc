@@ -0,0 +1,278 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class:       InferenceScheduler (art service)
+//
+// See InferenceScheduler.h
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/Services/InferenceScheduler.h"
+
+#include "art/Framework/Services/Registry/ActivityRegistry.h"
+#include "art/Utilities/Globals.h"
+#include "art/Utilities/make_tool.h"
+#include "canvas/Utilities/Exception.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlgTools/MakePointIdAlgTool.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/WaveformRecogTools/IWaveformRecog.h"
+
+#include <algorithm>
+
+namespace {
+  // heap order: higher priority first, then earlier submission
+  template <typename R>
+  bool
+  lessUrgent(std::unique_ptr<R> const& a, std::unique_ptr<R> const& b)
+  {
+    if (a->priority != b->priority) { return a->priority < b->priority; }
+    return a->seq > b->seq;
+  }
+}
+
+// ------------------------------------------------------
+nnet::InferenceScheduler::InferenceScheduler(fhicl::ParameterSet const& pset,
+                                             art::ActivityRegistry& reg)
+  : fMaxBatchSize(pset.get<size_t>("MaxBatchSize", 1024))
+  , fMaxLatency(std::chrono::microseconds(
+      static_cast<long long>(1000 * pset.get<double>("MaxLatency", 0.0))))
+  , fCallers(pset.get<size_t>("Callers", art::Globals::instance()->nthreads()))
+{
+  for (auto const& cfg : pset.get<std::vector<fhicl::ParameterSet>>("Models")) {
+    auto const name = cfg.get<std::string>("Name");
+    auto const type = cfg.get<std::string>("Type");
+    auto const toolPset = cfg.get<fhicl::ParameterSet>("Tool");
+    if (fModels.count(name)) {
+      throw art::Exception(art::errors::Configuration)
+        << "InferenceScheduler: model " << name << " defined twice.";
+    }
+
+    Model& model = fModels[name];
+    if (type == "PointIdAlg") {
+      std::shared_ptr<PointIdAlgTools::IPointIdAlg> tool =
+        PointIdAlgTools::makePointIdAlgTool(toolPset);
+      size_t const rows = toolPset.get<size_t>("PatchSizeW");
+      size_t const cols = toolPset.get<size_t>("PatchSizeD");
+      model.sampleSize = rows * cols;
+      model.run = [tool, rows, cols](Samples const& x) {
+        std::vector<std::vector<std::vector<float>>> inps(x.size(),
+                                                          std::vector<std::vector<float>>(rows));
+        for (size_t s = 0; s < x.size(); ++s) {
+          for (size_t r = 0; r < rows; ++r) {
+            inps[s][r].assign(x[s].begin() + r * cols, x[s].begin() + (r + 1) * cols);
+          }
+        }
+        return tool->Run(inps);
+      };
+      model.tool = tool;
+    }
+    else if (type == "WaveformRecog") {
+      std::shared_ptr<wavrec_tool::IWaveformRecog> tool =
+        art::make_tool<wavrec_tool::IWaveformRecog>(toolPset);
+      model.run = [tool](Samples const& x) { return tool->predictWaveformType(x); };
+      model.tool = tool;
+    }
+    else {
+      throw art::Exception(art::errors::Configuration)
+        << "InferenceScheduler: model type " << type << " not supported.";
+    }
+    mf::LogInfo("InferenceScheduler") << "Model " << name << " (" << type << ") loaded.";
+  }
+
+  size_t const nWorkers = std::max(1, pset.get<int>("Workers", 2));
+  for (size_t i = 0; i < nWorkers; ++i) {
+    fWorkers.emplace_back(&InferenceScheduler::worker, this);
+  }
+
+  reg.sPostEndJob.watch(this, &InferenceScheduler::endJob);
+}
+
+// ------------------------------------------------------
+nnet::InferenceScheduler::~InferenceScheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    fStop = true;
+  }
+  fCond.notify_all();
+  for (auto& w : fWorkers) {
+    w.join();
+  }
+}
+
+// ------------------------------------------------------
+size_t
+nnet::InferenceScheduler::sampleSize(std::string const& model) const
+{
+  auto const it = fModels.find(model);
+  if (it == fModels.end()) {
+    throw art::Exception(art::errors::Configuration)
+      << "InferenceScheduler: model " << model << " not defined.";
+  }
+  return it->second.sampleSize;
+}
+
+// ------------------------------------------------------
+std::future<nnet::InferenceScheduler::Samples>
+nnet::InferenceScheduler::submit(std::string const& model, Samples samples, int priority)
+{
+  return enqueue(model, std::move(samples), priority, false);
+}
+
+// ------------------------------------------------------
+std::future<nnet::InferenceScheduler::Samples>
+nnet::InferenceScheduler::enqueue(std::string const& model,
+                                  Samples samples,
+                                  int priority,
+                                  bool blocking)
+{
+  auto it = fModels.find(model);
+  if (it == fModels.end()) {
+    throw art::Exception(art::errors::Configuration)
+      << "InferenceScheduler: model " << model << " not defined.";
+  }
+
+  auto req = std::make_unique<Request>();
+  auto result = req->result.get_future();
+  if (samples.empty()) {
+    req->result.set_value(Samples());
+    return result;
+  }
+  req->samples = std::move(samples);
+  req->priority = priority;
+  req->arrival = Clock::now();
+  req->blocking = blocking;
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    Model& m = it->second;
+    req->seq = fSeq++;
+    m.queued += req->samples.size();
+    m.queue.push_back(std::move(req));
+    std::push_heap(m.queue.begin(), m.queue.end(), lessUrgent<Request>);
+    ++fPending;
+    if (blocking) { ++fBlocked; }
+  }
+  fCond.notify_all(); // also workers waiting for more requests to fill a batch
+  return result;
+}
+
+// ------------------------------------------------------
+nnet::InferenceScheduler::Model*
+nnet::InferenceScheduler::select()
+{
+  Model* best = nullptr;
+  for (auto& [name, m] : fModels) {
+    if (m.queue.empty()) { continue; }
+    if (!best || lessUrgent(best->queue.front(), m.queue.front())) { best = &m; }
+  }
+  return best;
+}
+
+// ------------------------------------------------------
+bool
+nnet::InferenceScheduler::allCallersBlocked() const
+{
+  return (fCallers > 0) && (fBlocked >= fCallers);
+}
+
+// ------------------------------------------------------
+void
+nnet::InferenceScheduler::worker()
+{
+  std::unique_lock<std::mutex> lock(fMutex);
+  while (true) {
+    fCond.wait(lock, [this] { return fStop || (fPending > 0); });
+    Model* m = select();
+    if (!m) { return; } // stopped and nothing left to do
+
+    // wait for more requests until the batch is full, the oldest request waits too long, or
+    // no more requests can come
+    auto oldest = Clock::time_point::max();
+    for (auto const& r : m->queue) {
+      oldest = std::min(oldest, r->arrival);
+    }
+    auto const deadline = oldest + fMaxLatency;
+    while (!fStop && (m->queued < fMaxBatchSize) && !m->queue.empty() &&
+           !allCallersBlocked()) {
+      if (fCond.wait_until(lock, deadline) == std::cv_status::timeout) { break; }
+    }
+    if (m->queue.empty()) { continue; } // taken by another worker
+
+    std::vector<std::unique_ptr<Request>> batch;
+    size_t n = 0;
+    while (!m->queue.empty()) {
+      size_t const size = m->queue.front()->samples.size();
+      if (!batch.empty() && (n + size > fMaxBatchSize)) { break; }
+      std::pop_heap(m->queue.begin(), m->queue.end(), lessUrgent<Request>);
+      batch.push_back(std::move(m->queue.back()));
+      m->queue.pop_back();
+      n += size;
+    }
+    m->queued -= n;
+    fPending -= batch.size();
+    ++m->nBatches;
+    m->nRequests += batch.size();
+    m->nSamples += n;
+
+    size_t nBlocking = 0;
+    for (auto const& r : batch) {
+      if (r->blocking) { ++nBlocking; }
+    }
+
+    // callers are released before they get the results, so they are not counted as blocked
+    // when they submit the next request
+    auto release = [&] {
+      lock.lock();
+      fBlocked -= nBlocking;
+      nBlocking = 0;
+      lock.unlock();
+    };
+
+    lock.unlock();
+    try {
+      Samples x;
+      if (batch.size() == 1) { x = std::move(batch.front()->samples); }
+      else {
+        x.reserve(n);
+        for (auto& r : batch) {
+          std::move(r->samples.begin(), r->samples.end(), std::back_inserter(x));
+        }
+      }
+      auto y = m->run(x);
+      if (y.size() != n) {
+        throw cet::exception("InferenceScheduler")
+          << "model returned " << y.size() << " outputs for " << n << " samples.";
+      }
+      release();
+      size_t s0 = 0;
+      for (auto& r : batch) {
+        size_t const size = (batch.size() == 1) ? n : r->samples.size();
+        r->result.set_value(Samples(std::make_move_iterator(y.begin() + s0),
+                                    std::make_move_iterator(y.begin() + s0 + size)));
+        s0 += size;
+      }
+    }
+    catch (...) {
+      if (nBlocking) { release(); }
+      for (auto& r : batch) {
+        r->result.set_exception(std::current_exception());
+      }
+    }
+    lock.lock();
+  }
+}
+
+// ------------------------------------------------------
+void
+nnet::InferenceScheduler::endJob()
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  mf::LogInfo log("InferenceScheduler");
+  for (auto const& [name, m] : fModels) {
+    if (!m.nBatches) { continue; }
+    log << "Model " << name << ": " << m.nRequests << " requests, " << m.nSamples
+        << " samples in " << m.nBatches << " batches, " << m.nSamples / m.nBatches
+        << " samples per batch on average.\n";
+  }
+}
+
+DEFINE_ART_SERVICE(nnet::InferenceScheduler)
@@ -0,0 +1,33 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//// tf_aot.h: interface of TF graphs compiled ahead of time
+////
+//// Frozen graph is compiled with tfcompile (XLA) for a fixed batch size into a function with
+//// no dependency on the TF runtime; tf_aot_compile.py prepares the tfcompile configuration and
+//// the source of a plugin library wrapping the generated class with the C interface below.
+//// The plugin is loaded with dlopen, e.g. by the PointIdAlgTfAot tool.
+////
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TF_AOT_H
+#define TF_AOT_H
+
+extern "C"
+{
+    struct tf_aot_info
+    {
+        const char * name;              // name of the source .pb file
+        int batch;                      // number of samples in one call, fixed at compile time
+        int in_rows, in_cols, in_depth; // shape of one input sample, as in tf::Graph::run
+        int out_size;                   // all outputs of one sample, concatenated
+    };
+
+    // symbols exported by the plugin:
+    //   const tf_aot_info * tf_aot_model_info(void);
+    //   int tf_aot_compute(const float * in, float * out); // in: batch x rows x cols x depth,
+    //                                                      // out: batch x out_size; 0 if ok
+    // tf_aot_compute is reentrant, each thread has its own instance of the compiled function
+    typedef const tf_aot_info * (*tf_aot_info_fn)(void);
+    typedef int (*tf_aot_compute_fn)(const float *, float *);
+}
+
+#endif
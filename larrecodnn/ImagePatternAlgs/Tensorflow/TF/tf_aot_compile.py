@@ -0,0 +1,120 @@
+"""
+Prepare ahead-of-time compilation of a frozen TF graph (.pb) with tfcompile, for a fixed batch
+size. Input and output nodes are selected as in tf::Graph: the first node of the graph is the
+input, outputs are the last nodes of the layers with names containing the given patterns.
+
+  python tf_aot_compile.py -i model.pb -o model_aot --rows 32 --cols 44 --batch 256 \\
+      --outputs cnn_output _netout
+
+writes model_aot.config.pbtxt (tfcompile feeds and fetches) and model_aot_plugin.cc (C
+interface of tf_aot.h), then the plugin is built e.g. with:
+
+  tfcompile --graph=model.pb --config=model_aot.config.pbtxt --cpp_class=nnet_aot::Model \\
+      --out_header=model_aot.h --out_object=model_aot.o
+  g++ -O2 -std=c++17 -shared -fPIC -I. -I$LARRECODNN_INC -I$TENSORFLOW_INC \\
+      model_aot_plugin.cc model_aot.o -o model_aot.so <XLA CPU runtime libraries>
+
+and used as NNetModelFile of the PointIdAlgTfAot tool. The last batch of each call is padded
+with zeros, so the batch size should match the typical number of patches per call.
+"""
+from __future__ import print_function
+import argparse
+import os
+
+parser = argparse.ArgumentParser(description='Prepare tfcompile config and plugin source for a frozen TF graph')
+
+parser.add_argument('-i', '--input', help="Frozen graph (.pb)", required=True)
+parser.add_argument('-o', '--output', help="Prefix of the output files", required=True)
+parser.add_argument('-r', '--rows', help="Rows of the input sample", type=int, required=True)
+parser.add_argument('-c', '--cols', help="Columns of the input sample", type=int, required=True)
+parser.add_argument('-d', '--depth', help="Depth of the input sample", type=int, default=1)
+parser.add_argument('-b', '--batch', help="Batch size compiled into the model", type=int, default=256)
+parser.add_argument('--outputs', help="Patterns of the output node names", nargs='*', default=[])
+parser.add_argument('--cpp-class', help="Class generated by tfcompile", default='nnet_aot::Model')
+
+args = parser.parse_args()
+
+import tensorflow as tf
+if hasattr(tf, 'compat') and hasattr(tf.compat, 'v1'):
+    tf = tf.compat.v1
+    tf.disable_eager_execution()
+
+
+def select_outputs(nodes, patterns):  # same as in tf::Graph::Graph
+    if not patterns:
+        return [nodes[-1]]
+    out, last, current = [], '', ''
+    for name in nodes:
+        if '/' not in name:
+            continue
+        basename = name[:name.find('/')]
+        if any(p in name for p in patterns):
+            if last and basename != current:
+                out.append(last)
+            current, last = basename, name
+    if last:
+        out.append(last)
+    return out
+
+
+graph_def = tf.GraphDef()
+with open(args.input, 'rb') as f:
+    graph_def.ParseFromString(f.read())
+
+nodes = [n.name for n in graph_def.node]
+in_name = nodes[0]
+out_names = select_outputs(nodes, args.outputs)
+if not out_names:
+    raise ValueError('Output nodes not found in the graph.')
+
+# output sizes with the fixed input shape
+in_shape = [args.batch, args.rows, args.cols, args.depth]
+with tf.Graph().as_default():
+    x = tf.placeholder(tf.float32, in_shape)
+    outs = tf.import_graph_def(graph_def, input_map={in_name + ':0': x},
+                               return_elements=[n + ':0' for n in out_names])
+    shapes = [o.shape.as_list() for o in outs]
+    if any(d is None for s in shapes for d in s):
+        with tf.Session() as sess:
+            shapes = [list(v.shape) for v in sess.run(outs, {x: [[[[0.0] * args.depth] * args.cols] * args.rows] * args.batch})]
+for n, s in zip(out_names, shapes):
+    if len(s) != 2 or s[0] != args.batch:
+        raise ValueError('Output %s has shape %s, expected [batch, n].' % (n, s))
+out_sizes = [s[1] for s in shapes]
+
+with open(args.output + '.config.pbtxt', 'w') as fout:
+    fout.write('feed {\n  id { node_name: "%s" }\n  shape {\n' % in_name)
+    for d in in_shape:
+        fout.write('    dim { size: %d }\n' % d)
+    fout.write('  }\n}\n')
+    for n in out_names:
+        fout.write('fetch {\n  id { node_name: "%s" }\n}\n' % n)
+
+name = os.path.basename(args.input)
+header = os.path.basename(args.output) + '.h'
+with open(args.output + '_plugin.cc', 'w') as fout:
+    fout.write('// Generated with tf_aot_compile.py from %s, batch %d, input %d x %d x %d. Do not edit.\n\n' %
+               (name, args.batch, args.rows, args.cols, args.depth))
+    fout.write('#include "larrecodnn/ImagePatternAlgs/Tensorflow/TF/tf_aot.h"\n')
+    fout.write('#include "%s" // generated by tfcompile\n\n' % header)
+    fout.write('#include <algorithm>\n\n')
+    fout.write('namespace {\n  constexpr int kBatch = %d, kInSize = %d, kOutSize = %d;\n' %
+               (args.batch, args.batch * args.rows * args.cols * args.depth, sum(out_sizes)))
+    fout.write('  constexpr int kOutputs = %d;\n' % len(out_sizes))
+    fout.write('  constexpr int kSizes[kOutputs] = {%s};\n}\n\n' % ', '.join(str(n) for n in out_sizes))
+    fout.write('extern "C" const tf_aot_info * tf_aot_model_info(void)\n{\n')
+    fout.write('  static const tf_aot_info info = {"%s", kBatch, %d, %d, %d, kOutSize};\n' %
+               (name, args.rows, args.cols, args.depth))
+    fout.write('  return &info;\n}\n\n')
+    fout.write('extern "C" int tf_aot_compute(const float * in, float * out)\n{\n')
+    fout.write('  static thread_local %s model; // buffers of the compiled function, one set per thread\n' % args.cpp_class)
+    fout.write('  std::copy(in, in + kInSize, static_cast<float*>(model.arg_data(0)));\n')
+    fout.write('  if (!model.Run()) { return 1; }\n\n')
+    fout.write('  for (int o = 0, off = 0; o < kOutputs; off += kSizes[o++]) {\n')
+    fout.write('    const float * r = static_cast<const float*>(model.result_data(o));\n')
+    fout.write('    for (int s = 0; s < kBatch; ++s) {\n')
+    fout.write('      std::copy(r + s * kSizes[o], r + (s + 1) * kSizes[o], out + s * kOutSize + off);\n')
+    fout.write('    }\n  }\n  return 0;\n}\n')
+
+print('Input', in_name, 'outputs', out_names, 'sizes', out_sizes)
+print('Written', args.output + '.config.pbtxt', 'and', args.output + '_plugin.cc')
@@ -13,33 +13,189 @@
 #include "tensorflow/core/platform/env.h"
 
 #include "tensorflow/core/public/session_options.h"
+#include "tensorflow/core/protobuf/rewriter_config.pb.h"
 
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::mutex tf::Graph::fRegistryMutex;
+std::map< tf::Graph::Key, std::weak_ptr<tf::Graph> > tf::Graph::fRegistry;
+
+namespace
+{
+    // "^name" (control input) or "name:1" (output 1 of the node) -> "name"
+    std::string node_name(const std::string & input)
+    {
+        size_t begin = (!input.empty() && (input[0] == '^')) ? 1 : 0;
+        return input.substr(begin, input.find(':') - begin);
+    }
+
+    // only nodes needed to compute outputs, in the original order
+    tensorflow::GraphDef prune(const tensorflow::GraphDef & in, const std::vector<std::string> & keep)
+    {
+        std::map< std::string, int > index;
+        for (int n = 0; n < in.node_size(); ++n) { index[in.node(n).name()] = n; }
+
+        std::set< std::string > needed(keep.begin(), keep.end());
+        std::vector< std::string > todo(keep.begin(), keep.end());
+        while (!todo.empty())
+        {
+            auto it = index.find(todo.back());
+            todo.pop_back();
+            if (it == index.end()) { continue; }
+            for (const auto & input : in.node(it->second).input())
+            {
+                if (needed.insert(node_name(input)).second) { todo.push_back(node_name(input)); }
+            }
+        }
+
+        tensorflow::GraphDef out;
+        *out.mutable_versions() = in.versions();
+        *out.mutable_library() = in.library();
+        for (const auto & node : in.node())
+        {
+            if (needed.count(node.name())) { *out.add_node() = node; }
+        }
+        return out;
+    }
+
+    // Subgraph feeding the outputs, with Identity nodes bypassed (those left e.g. by freezing
+    // variables or by Keras dropout in the inference mode).
+    tensorflow::GraphDef optimize(const tensorflow::GraphDef & in, const std::string & input,
+                                  const std::vector<std::string> & outputs)
+    {
+        std::vector< std::string > keep(outputs);
+        keep.push_back(input);
+        auto graph_def = prune(in, keep);
+
+        std::map< std::string, std::string > bypass; // Identity node -> its input
+        for (const auto & node : graph_def.node())
+        {
+            if ((node.op() == "Identity") && (node.input_size() > 0) && (node.input(0)[0] != '^') &&
+                (std::find(keep.begin(), keep.end(), node.name()) == keep.end()))
+            {
+                bypass[node.name()] = node.input(0);
+            }
+        }
+        for (auto & node : *graph_def.mutable_node())
+        {
+            for (auto & input : *node.mutable_input())
+            {
+                bool control = (input[0] == '^');
+                for (auto it = bypass.find(node_name(input)); it != bypass.end(); it = bypass.find(node_name(input)))
+                {
+                    auto pos = input.find(':');
+                    if (control) { input = "^" + node_name(it->second); }
+                    else if ((pos == std::string::npos) || (input.compare(pos, 3, ":0") == 0)) { input = it->second; }
+                    else break; // Identity has just one output, keep strange inputs untouched
+                }
+            }
+        }
+        return prune(graph_def, keep);
+    }
+
+    // optimized graph cached next to the original file, separately for each set of output patterns
+    std::string cached_file_name(const char* graph_file_name, const std::vector<std::string> & outputs)
+    {
+        std::string patterns;
+        for (const auto & s : outputs) { patterns += s + '\n'; }
+        char hash[32];
+        snprintf(hash, sizeof(hash), "%08zx", std::hash<std::string>()(patterns) & 0xffffffff);
+        return std::string(graph_file_name) + "." + hash + ".opt";
+    }
+
+    bool is_newer(const std::string & a, const char* b)
+    {
+        struct stat sa, sb;
+        return (stat(a.c_str(), &sa) == 0) && (stat(b, &sb) == 0) && (sa.st_mtime >= sb.st_mtime);
+    }
+}
+
+// -------------------------------------------------------------------
+std::shared_ptr<tf::Graph> tf::Graph::get(const char* graph_file_name, const std::vector<std::string> & outputs,
+                                          const Options & options)
+{
+    // the same file may be given with different paths
+    std::string path = graph_file_name;
+    if (char* real = realpath(graph_file_name, nullptr)) { path = real; free(real); }
+    Key key(path, outputs, options);
+
+    std::lock_guard<std::mutex> lock(fRegistryMutex);
+    auto it = fRegistry.find(key);
+    if (it != fRegistry.end())
+    {
+        if (auto g = it->second.lock()) { return g; }
+    }
+
+    std::shared_ptr<Graph> g(create(graph_file_name, outputs, options));
+    if (g) { fRegistry[key] = g; }
+    else { fRegistry.erase(key); }
+
+    for (auto r = fRegistry.begin(); r != fRegistry.end(); ) // forget released graphs
+    {
+        if (r->second.expired()) { r = fRegistry.erase(r); }
+        else { ++r; }
+    }
+    return g;
+}
 // -------------------------------------------------------------------
-tf::Graph::Graph(const char* graph_file_name, const std::vector<std::string> & outputs, bool & success)
+
+tf::Graph::Graph(const char* graph_file_name, const std::vector<std::string> & outputs, const Options & options,
+                 bool & success)
 {
     success = false; // until all is done correctly
 
-    // Force tf to only use a single core so it doesn't eat batch farms
-    tensorflow::SessionOptions options;
-    tensorflow::ConfigProto &config = options.config;
-    config.set_inter_op_parallelism_threads(1);
-    config.set_intra_op_parallelism_threads(1);
+    tensorflow::SessionOptions session_options;
+    tensorflow::ConfigProto &config = session_options.config;
+    config.set_inter_op_parallelism_threads(options.inter_op_threads);
+    config.set_intra_op_parallelism_threads(options.intra_op_threads);
     config.set_use_per_session_threads(false);
+    if (options.xla_jit)
+    {
+        config.mutable_graph_options()->mutable_optimizer_options()->set_global_jit_level(
+            tensorflow::OptimizerOptions::ON_1);
+    }
+    if (options.optimize)
+    {
+        // constant folding, and fused conv + bias + activation kernels (grappler remapper)
+        auto optimizer = config.mutable_graph_options()->mutable_optimizer_options();
+        optimizer->set_opt_level(tensorflow::OptimizerOptions::L1);
+        optimizer->set_do_constant_folding(true);
+        auto rewriter = config.mutable_graph_options()->mutable_rewrite_options();
+        rewriter->set_constant_folding(tensorflow::RewriterConfig::ON);
+        rewriter->set_remapping(tensorflow::RewriterConfig::ON);
+        rewriter->set_dependency_optimization(tensorflow::RewriterConfig::ON);
+    }
 
-    auto status = tensorflow::NewSession(options, &fSession);
+    auto status = tensorflow::NewSession(session_options, &fSession);
     if (!status.ok())
     {
         std::cout << status.ToString() << std::endl;
         return;
     }
 
+    // graph already optimized for these outputs, if cached and up to date
+    std::string cached = cached_file_name(graph_file_name, outputs);
+    bool from_cache = options.optimize && options.cache && is_newer(cached, graph_file_name);
+
     tensorflow::GraphDef graph_def;
-    status = tensorflow::ReadBinaryProto(tensorflow::Env::Default(), graph_file_name, &graph_def);
+    status = tensorflow::ReadBinaryProto(tensorflow::Env::Default(), from_cache ? cached : graph_file_name, &graph_def);
+    if (!status.ok() && from_cache)
+    {
+        from_cache = false;
+        status = tensorflow::ReadBinaryProto(tensorflow::Env::Default(), graph_file_name, &graph_def);
+    }
     if (!status.ok())
     {
         std::cout << status.ToString() << std::endl;
         return;
     }
+    if (from_cache) { std::cout << "Optimized graph read from " << cached << std::endl; }
 
     size_t ng = graph_def.node().size();
     fInputName = graph_def.node()[0].name();
@@ -79,6 +235,24 @@ tf::Graph::Graph(const char* graph_file_name, const std::vector<std::string> & o
         return;
     }
 
+    if (options.optimize && !from_cache)
+    {
+        int nodes = graph_def.node_size();
+        graph_def = optimize(graph_def, fInputName, fOutputNames);
+        std::cout << "Graph pruned from " << nodes << " to " << graph_def.node_size() << " nodes." << std::endl;
+
+        if (options.cache) // write to a temporary file first, other jobs may read the cache
+        {
+            std::string tmp = cached + "." + std::to_string(getpid());
+            if (tensorflow::WriteBinaryProto(tensorflow::Env::Default(), tmp, graph_def).ok() &&
+                (rename(tmp.c_str(), cached.c_str()) == 0))
+            {
+                std::cout << "Optimized graph cached in " << cached << std::endl;
+            }
+            else { remove(tmp.c_str()); }
+        }
+    }
+
     status = fSession->Create(graph_def);
     if (!status.ok())
     {
@@ -96,7 +270,7 @@ tf::Graph::~Graph()
 }
 // -------------------------------------------------------------------
 
-std::vector<float> tf::Graph::run(const std::vector< std::vector<float> > & x)
+std::vector<float> tf::Graph::run(const std::vector< std::vector<float> > & x) const
 {
     if (x.empty() || x.front().empty()) { return std::vector<float>(); }
 
@@ -120,7 +294,7 @@ std::vector<float> tf::Graph::run(const std::vector< std::vector<float> > & x)
 
 std::vector< std::vector<float> > tf::Graph::run(
 	const std::vector<  std::vector<  std::vector< std::vector<float> > > > & x,
-	long long int samples)
+	long long int samples) const
 {
     if ((samples == 0) || x.empty() || x.front().empty() || x.front().front().empty() || x.front().front().front().empty())
         return std::vector< std::vector<float> >();
@@ -151,7 +325,7 @@ std::vector< std::vector<float> > tf::Graph::run(
 }
 // -------------------------------------------------------------------
 
-std::vector< std::vector< float > > tf::Graph::run(const tensorflow::Tensor & x)
+std::vector< std::vector< float > > tf::Graph::run(const tensorflow::Tensor & x) const
 {
     std::vector< std::pair<std::string, tensorflow::Tensor> > inputs = {
         { fInputName, x }
@@ -11,6 +11,9 @@
 #define Graph_h
 
 #include <memory>
+#include <mutex>
+#include <map>
+#include <tuple>
 #include <vector>
 #include <string>
 
@@ -23,31 +26,62 @@ namespace tensorflow
 namespace tf
 {
 
+/// Session settings, by default single thread so it doesn't eat batch farms.
+struct GraphOptions
+{
+    int intra_op_threads = 1;
+    int inter_op_threads = 1;
+    bool xla_jit = false; // compile clusters of ops with XLA, ignored if TF is built without XLA
+    bool optimize = false; // prune to the outputs subgraph, bypass Identity, fold constants, fuse ops
+    bool cache = false;    // save the pruned graph next to the model file and use it next time
+
+    bool operator<(const GraphOptions & o) const
+    {
+        return std::tie(intra_op_threads, inter_op_threads, xla_jit, optimize, cache) <
+               std::tie(o.intra_op_threads, o.inter_op_threads, o.xla_jit, o.optimize, o.cache);
+    }
+};
+
 class Graph
 {
 public:
-    static std::unique_ptr<Graph> create(const char* graph_file_name, const std::vector<std::string> & outputs = {})
+    typedef GraphOptions Options;
+
+    /// New graph owned by the caller.
+    static std::unique_ptr<Graph> create(const char* graph_file_name, const std::vector<std::string> & outputs = {},
+                                         const Options & options = Options())
     {
         bool success;
-        std::unique_ptr<Graph> ptr(new Graph(graph_file_name, outputs,  success));
+        std::unique_ptr<Graph> ptr(new Graph(graph_file_name, outputs, options, success));
         if (success) { return ptr; }
         else { return nullptr; }
     }
 
+    /// Graph shared within the process: all callers asking for the same file, output patterns
+    /// and options get the same session (and one copy of weights). The graph is released when
+    /// the last user is gone. Returns nullptr if the graph can not be loaded.
+    static std::shared_ptr<Graph> get(const char* graph_file_name, const std::vector<std::string> & outputs = {},
+                                      const Options & options = Options());
+
     ~Graph();
 
-    std::vector<float> run(const std::vector< std::vector<float> > & x);
+    // run methods can be called concurrently, also on a shared graph
+    std::vector<float> run(const std::vector< std::vector<float> > & x) const;
 
     // process vector of 3D inputs, return vector of 1D outputs; use all inputs
     // if samples = -1, or only the specified number of first samples
     std::vector< std::vector<float> > run(
 	const std::vector< std::vector< std::vector< std::vector<float> > > > & x,
-	long long int samples = -1);
-    std::vector< std::vector< float > > run(const tensorflow::Tensor & x);
+	long long int samples = -1) const;
+    std::vector< std::vector< float > > run(const tensorflow::Tensor & x) const;
 
 private:
     /// Not-throwing constructor.
-    Graph(const char* graph_file_name, const std::vector<std::string> & outputs, bool & success);
+    Graph(const char* graph_file_name, const std::vector<std::string> & outputs, const Options & options, bool & success);
+
+    typedef std::tuple< std::string, std::vector<std::string>, Options > Key;
+    static std::mutex fRegistryMutex;
+    static std::map< Key, std::weak_ptr<Graph> > fRegistry;
 
     tensorflow::Session* fSession;
     std::string fInputName;
@@ -22,23 +22,37 @@ namespace wavrec_tool {
     std::vector<bool>
     findROI(const std::vector<float>& adcin) const
     {
-      std::vector<bool> bvec(fWaveformSize, false);
-      if (adcin.size() != fWaveformSize) { return bvec; }
+      if (adcin.size() != fWaveformSize) { return std::vector<bool>(fWaveformSize, false); }
 
-      std::vector<std::vector<float>> predv = scanWaveform(adcin);
+      return windowsToROI(scanWaveform(adcin), 0);
+    }
 
-      // .. set to true all bins in the output vector that are in windows identified as signals
-      int j1;
-      for (unsigned int i = 0; i < fNumStrides; i++) {
-        j1 = i * fStrideLength;
-        if (predv[i][0] > fCnnPredCut) { std::fill_n(bvec.begin() + j1, fWindowSize, true); }
+    // ---------------------------------------------------------------------
+    // Same as findROI for several waveforms, windows of all waveforms are
+    // passed to the CNN in one batch.
+    // ---------------------------------------------------------------------
+    std::vector<std::vector<bool>>
+    findROIs(const std::vector<std::vector<float>>& adcins) const
+    {
+      std::vector<std::vector<float>> wwv;
+      wwv.reserve(adcins.size() * (fNumStrides + 1));
+      for (auto const& adcin : adcins) {
+        if (adcin.size() == fWaveformSize) { addWindows(adcin, wwv); }
       }
-      // .. last window is a special case
-      if (predv[fNumStrides][0] > fCnnPredCut) {
-        j1 = fNumStrides * fStrideLength;
-        std::fill_n(bvec.begin() + j1, fLastWindowSize, true);
+      std::vector<std::vector<float>> predv;
+      if (!wwv.empty()) { predv = predictWaveformType(wwv); }
+
+      std::vector<std::vector<bool>> result;
+      result.reserve(adcins.size());
+      size_t w0 = 0;
+      for (auto const& adcin : adcins) {
+        if (adcin.size() != fWaveformSize) { result.emplace_back(fWaveformSize, false); }
+        else {
+          result.push_back(windowsToROI(predv, w0));
+          w0 += fNumStrides + 1;
+        }
       }
-      return bvec;
+      return result;
     }
 
     // -------------------------------------------------------------
@@ -163,8 +177,42 @@ namespace wavrec_tool {
     unsigned int fNumStrides;
     unsigned int fLastWindowSize;
 
+    // .. bins of the waveform in windows w0, w0 + 1, ... identified as signals
+    std::vector<bool>
+    windowsToROI(const std::vector<std::vector<float>>& predv, size_t w0) const
+    {
+      std::vector<bool> bvec(fWaveformSize, false);
+
+      // .. set to true all bins in the output vector that are in windows identified as signals
+      int j1;
+      for (unsigned int i = 0; i < fNumStrides; i++) {
+        j1 = i * fStrideLength;
+        if (predv[w0 + i][0] > fCnnPredCut) {
+          std::fill_n(bvec.begin() + j1, fWindowSize, true);
+        }
+      }
+      // .. last window is a special case
+      if (predv[w0 + fNumStrides][0] > fCnnPredCut) {
+        j1 = fNumStrides * fStrideLength;
+        std::fill_n(bvec.begin() + j1, fLastWindowSize, true);
+      }
+      return bvec;
+    }
+
     std::vector<std::vector<float>>
     scanWaveform(const std::vector<float>& adcin) const
+    {
+      std::vector<std::vector<float>> wwv;
+      wwv.reserve(fNumStrides + 1);
+      addWindows(adcin, wwv);
+
+      // ... use waveform recognition CNN to perform inference on each window
+      return predictWaveformType(wwv);
+    }
+
+    // .. append scan windows of the waveform to wwv
+    void
+    addWindows(const std::vector<float>& adcin, std::vector<std::vector<float>>& wwv) const
     {
       // .. rescale input waveform for CNN
       std::vector<float> adc(fWaveformSize);
@@ -173,7 +221,8 @@ namespace wavrec_tool {
       }
 
       // .. create a vector of windows
-      std::vector<std::vector<float>> wwv(fNumStrides + 1, std::vector<float>(fWindowSize, 0.));
+      size_t const first = wwv.size();
+      wwv.resize(first + fNumStrides + 1, std::vector<float>(fWindowSize, 0.));
 
       // .. fill each window with adc values
       unsigned int j1, j2, k;
@@ -182,7 +231,7 @@ namespace wavrec_tool {
         j2 = j1 + fWindowSize;
         k = 0;
         for (unsigned int j = j1; j < j2; j++) {
-          wwv[i][k] = adc[j];
+          wwv[first + i][k] = adc[j];
           k++;
         }
       }
@@ -191,12 +240,9 @@ namespace wavrec_tool {
       j2 = j1 + fLastWindowSize;
       k = 0;
       for (unsigned int j = j1; j < j2; j++) {
-        wwv[fNumStrides][k] = adc[j];
+        wwv[first + fNumStrides][k] = adc[j];
         k++;
       }
-
-      // ... use waveform recognition CNN to perform inference on each window
-      return predictWaveformType(wwv);
     }
   };
 }
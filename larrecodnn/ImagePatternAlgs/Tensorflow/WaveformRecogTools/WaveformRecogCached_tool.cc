@@ -0,0 +1,72 @@
+#include "art/Utilities/ToolMacros.h"
+#include "art/Utilities/make_tool.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/PointIdAlg/OutputCache.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/WaveformRecogTools/IWaveformRecog.h"
+
+namespace wavrec_tool {
+
+  // Outputs of the model given in the Tool table are kept in an on-disk cache, one file per model,
+  // CacheFile.<model key>, keyed by the window content; only windows not seen before are passed
+  // to the model.
+  // Parameters not given in Tool are taken from the table of this tool.
+  class WaveformRecogCached : public IWaveformRecog {
+  public:
+    explicit WaveformRecogCached(const fhicl::ParameterSet& pset);
+
+    std::vector<std::vector<float>> predictWaveformType(
+      const std::vector<std::vector<float>>&) const override;
+
+  private:
+    std::unique_ptr<IWaveformRecog> fModel;
+    std::unique_ptr<nnet::OutputCache> fCache;
+  };
+
+  // ------------------------------------------------------
+  WaveformRecogCached::WaveformRecogCached(const fhicl::ParameterSet& pset)
+  {
+    auto common = pset;
+    common.erase("Tool");
+    common.erase("CacheFile");
+    common.erase("tool_type");
+    auto const modelPset = fhicl::ParameterSet::make(
+      common.to_string() + " " + pset.get<fhicl::ParameterSet>("Tool").to_string());
+
+    fModel = art::make_tool<IWaveformRecog>(modelPset);
+    fCache = std::make_unique<nnet::OutputCache>(pset.get<std::string>("CacheFile"),
+                                                 nnet::OutputCache::modelKey(modelPset),
+                                                 "WaveformRecogCached");
+
+    setupWaveRecRoiParams(pset);
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  WaveformRecogCached::predictWaveformType(const std::vector<std::vector<float>>& waveforms) const
+  {
+    std::vector<std::vector<float>> out(waveforms.size());
+    std::vector<std::uint64_t> keys;
+    std::vector<size_t> missing;
+    std::vector<std::vector<float>> missingWindows;
+    for (size_t w = 0; w < waveforms.size(); ++w) {
+      auto const key = fCache->key(waveforms[w]);
+      if (!fCache->find(key, out[w])) {
+        keys.push_back(key);
+        missing.push_back(w);
+        missingWindows.push_back(waveforms[w]);
+      }
+    }
+    if (missing.empty()) { return out; }
+
+    auto modelOut = fModel->predictWaveformType(missingWindows);
+    if (modelOut.size() != missing.size()) {
+      throw cet::exception("WaveformRecogCached") << "Model failed." << std::endl;
+    }
+    for (size_t i = 0; i < missing.size(); ++i) {
+      fCache->insert(keys[i], modelOut[i]);
+      out[missing[i]] = std::move(modelOut[i]);
+    }
+    return out;
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(wavrec_tool::WaveformRecogCached)
@@ -0,0 +1,65 @@
+#include "art/Utilities/ToolMacros.h"
+#include "larrecodnn/ImagePatternAlgs/ONNX/onnx_model.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/WaveformRecogTools/IWaveformRecog.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include <sys/stat.h>
+
+namespace wavrec_tool {
+
+  class WaveformRecogOnnx : public IWaveformRecog {
+  public:
+    explicit WaveformRecogOnnx(const fhicl::ParameterSet& pset);
+
+    std::vector<std::vector<float>> predictWaveformType(
+      const std::vector<std::vector<float>>&) const override;
+
+  private:
+    std::unique_ptr<ort::Model> m; // network model, input: samples x ticks (x 1)
+    std::string fNNetModelFilePath;
+    std::vector<std::string> fNNetOutputPattern;
+  };
+
+  // ------------------------------------------------------
+  WaveformRecogOnnx::WaveformRecogOnnx(const fhicl::ParameterSet& pset)
+  {
+    fNNetModelFilePath = pset.get<std::string>("NNetModelFile", "mymodel.onnx");
+    fNNetOutputPattern = pset.get<std::vector<std::string>>("NNetOutputPattern", {});
+
+    ort::ModelOptions options;
+    options.intra_op_threads = pset.get<int>("IntraOpThreads", 1);
+    options.inter_op_threads = pset.get<int>("InterOpThreads", 1);
+    options.optimization = pset.get<std::string>("Optimization", "all");
+    options.io_binding = pset.get<bool>("IoBinding", false);
+
+    m = ort::Model::create(
+      findFile(fNNetModelFilePath.c_str()).c_str(), fNNetOutputPattern, options);
+    if (!m) { throw art::Exception(art::errors::Unknown) << "ONNX model failed."; }
+    mf::LogInfo("WaveformRecogOnnx") << "ONNX model loaded.";
+
+    setupWaveRecRoiParams(pset);
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  WaveformRecogOnnx::predictWaveformType(const std::vector<std::vector<float>>& waveforms) const
+  {
+    if (waveforms.empty() || waveforms.front().empty()) {
+      return std::vector<std::vector<float>>();
+    }
+    if (waveforms.front().size() != m->input_size()) {
+      throw art::Exception(art::errors::Configuration)
+        << "ONNX model input size " << m->input_size() << ", waveform window "
+        << waveforms.front().size() << ".";
+    }
+
+    std::vector<float> inp;
+    inp.reserve(waveforms.size() * m->input_size());
+    for (auto const& wvfrm : waveforms) {
+      inp.insert(inp.end(), wvfrm.begin(), wvfrm.end());
+    }
+    return m->run(inp, waveforms.size());
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(wavrec_tool::WaveformRecogOnnx)
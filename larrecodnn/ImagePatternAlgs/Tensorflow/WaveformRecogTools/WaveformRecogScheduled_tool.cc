@@ -0,0 +1,45 @@
+#include "art/Framework/Services/Registry/ServiceHandle.h"
+#include "art/Utilities/ToolMacros.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/Services/InferenceScheduler.h"
+#include "larrecodnn/ImagePatternAlgs/Tensorflow/WaveformRecogTools/IWaveformRecog.h"
+
+namespace wavrec_tool {
+
+  // Windows of waveforms are passed to a model owned by the InferenceScheduler service, batched
+  // there with requests of other modules and threads
+  class WaveformRecogScheduled : public IWaveformRecog {
+  public:
+    explicit WaveformRecogScheduled(const fhicl::ParameterSet& pset);
+
+    std::vector<std::vector<float>> predictWaveformType(
+      const std::vector<std::vector<float>>&) const override;
+
+  private:
+    nnet::InferenceScheduler* fScheduler;
+    std::string fModel;
+    int fPriority;
+  };
+
+  // ------------------------------------------------------
+  WaveformRecogScheduled::WaveformRecogScheduled(const fhicl::ParameterSet& pset)
+    : fScheduler(art::ServiceHandle<nnet::InferenceScheduler>().get())
+    , fModel(pset.get<std::string>("SchedulerModel"))
+    , fPriority(pset.get<int>("SchedulerPriority", 0))
+  {
+    if (!fScheduler->hasModel(fModel)) {
+      throw art::Exception(art::errors::Configuration)
+        << "WaveformRecogScheduled: model " << fModel << " not defined in the InferenceScheduler.";
+    }
+    setupWaveRecRoiParams(pset);
+  }
+
+  // ------------------------------------------------------
+  std::vector<std::vector<float>>
+  WaveformRecogScheduled::predictWaveformType(
+    const std::vector<std::vector<float>>& waveforms) const
+  {
+    return fScheduler->run(fModel, waveforms, fPriority);
+  }
+
+}
+DEFINE_ART_CLASS_TOOL(wavrec_tool::WaveformRecogScheduled)
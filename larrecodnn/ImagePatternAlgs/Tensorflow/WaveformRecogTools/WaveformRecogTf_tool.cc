@@ -16,7 +16,7 @@ namespace wavrec_tool {
       const std::vector<std::vector<float>>&) const override;
 
   private:
-    std::unique_ptr<tf::Graph> g; // network graph
+    std::shared_ptr<tf::Graph> g; // network graph, shared with other users of the model
     std::string fNNetModelFilePath;
     std::vector<std::string> fNNetOutputPattern;
   };
@@ -29,7 +29,12 @@ namespace wavrec_tool {
       pset.get<std::vector<std::string>>("NNetOutputPattern", {"cnn_output", "dense_3"});
     if ((fNNetModelFilePath.length() > 3) &&
         (fNNetModelFilePath.compare(fNNetModelFilePath.length() - 3, 3, ".pb") == 0)) {
-      g = tf::Graph::create(findFile(fNNetModelFilePath.c_str()).c_str(), fNNetOutputPattern);
+      tf::GraphOptions options;
+      options.xla_jit = pset.get<bool>("XlaJit", false);
+      options.optimize = pset.get<bool>("OptimizeGraph", false);
+      options.cache = pset.get<bool>("CacheGraph", false);
+      g = tf::Graph::get(
+        findFile(fNNetModelFilePath.c_str()).c_str(), fNNetOutputPattern, options);
       if (!g) { throw art::Exception(art::errors::Unknown) << "TF model failed."; }
       mf::LogInfo("WaveformRecogTf") << "TF model loaded.";
     }